@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "corpus/corpus.hpp"
+#include "json/json.hpp"
+
+// jsonquery_bench_compare: compares the json results (JSONQUERY_BENCH_JSON,
+// see bench/reporter.hpp) of repeated runs of jsonquery_bench of a baseline
+// and the current tree. Used by bench_compare.sh.
+//
+// The samples of all runs of a benchmark are pooled, compared by their
+// median and a 95% bootstrap confidence interval of the median. A benchmark
+// regressed if its median is more than the threshold slower AND the
+// intervals don't overlap (so noise alone doesn't fail the gate). A benchmark
+// of the baseline that is missing from the current results (e.g. because it
+// crashed or was renamed) also fails the gate, unless --allow-missing is given.
+
+namespace {
+
+class CompareError : public std::exception {
+    std::string what_;
+
+public:
+    CompareError(const std::string& message) : what_(message) {}
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+struct Series {
+    std::string test_case;
+    std::string name;
+    std::vector<double> samples;
+    std::size_t runs = 0;
+};
+
+struct Estimate {
+    double median = 0;
+    double low = 0;
+    double high = 0;
+};
+
+const json::JsonNode& member(const json::JsonObject& object,
+                             const std::string& key) {
+    const json::JsonNode* value = object.find(key);
+    if (value == nullptr) {
+        throw CompareError("benchmark result without \"" + key + "\"");
+    }
+    return *value;
+}
+
+/**
+ * All benchmarks of all result files in `directory` by test case and name.
+ */
+std::map<std::string, Series> load_runs(const std::string& directory) {
+    std::map<std::string, Series> results;
+    std::size_t files = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() != ".json") {
+            continue;
+        }
+        std::ifstream in(entry.path());
+        const std::string content((std::istreambuf_iterator<char>(in)),
+                                  std::istreambuf_iterator<char>());
+        const json::JsonNode json = json::parse_json(content);
+        const json::JsonArray& benchmarks =
+            member(json.as<json::JsonObject>(), "benchmarks")
+                .as<json::JsonArray>();
+        for (const json::JsonNode& node : benchmarks.get()) {
+            const auto& benchmark = node.as<json::JsonObject>();
+            const std::string test_case =
+                member(benchmark, "test_case").as<json::JsonString>().get();
+            const std::string name =
+                member(benchmark, "name").as<json::JsonString>().get();
+            Series& series = results[test_case + "\n" + name];
+            series.test_case = test_case;
+            series.name = name;
+            series.runs++;
+            for (const json::JsonNode& sample :
+                 member(benchmark, "samples_ns").as<json::JsonArray>().get()) {
+                series.samples.push_back(
+                    std::stod(sample.as<json::JsonNumber>().get()));
+            }
+        }
+        files++;
+    }
+    if (files == 0) {
+        throw CompareError("no benchmark results in " + directory);
+    }
+    return results;
+}
+
+double median_of(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const std::size_t mid = values.size() / 2;
+    return values.size() % 2 == 1 ? values[mid]
+                                  : (values[mid - 1] + values[mid]) / 2;
+}
+
+/**
+ * Median with its 95% percentile bootstrap confidence interval (the random
+ * numbers are seeded so the same results always give the same interval).
+ */
+Estimate estimate(const std::vector<double>& samples) {
+    constexpr std::size_t RESAMPLES = 1000;
+    corpus::Rng rng(42);
+    std::vector<double> medians;
+    medians.reserve(RESAMPLES);
+    std::vector<double> resample(samples.size());
+    for (std::size_t i = 0; i < RESAMPLES; ++i) {
+        for (double& value : resample) {
+            value = samples[rng.below(samples.size())];
+        }
+        medians.push_back(median_of(resample));
+    }
+    std::sort(medians.begin(), medians.end());
+    return Estimate{median_of(samples), medians[RESAMPLES * 25 / 1000],
+                    medians[RESAMPLES * 975 / 1000]};
+}
+
+std::string format_time(double ns) {
+    std::ostringstream o;
+    o << std::fixed << std::setprecision(1);
+    if (ns >= 1e9) {
+        o << ns / 1e9 << " s";
+    } else if (ns >= 1e6) {
+        o << ns / 1e6 << " ms";
+    } else if (ns >= 1e3) {
+        o << ns / 1e3 << " us";
+    } else {
+        o << ns << " ns";
+    }
+    return o.str();
+}
+
+void write_string(std::ostream& o, const std::string& s) {
+    // the names were read from json and are still escaped
+    o << '"' << s << '"';
+}
+
+void write_estimate(std::ostream& o, const Series& series,
+                    const Estimate& e) {
+    o << "{\"median_ns\":" << e.median << ",\"low_ns\":" << e.low
+      << ",\"high_ns\":" << e.high << ",\"runs\":" << series.runs
+      << ",\"samples\":" << series.samples.size() << "}";
+}
+
+void print_help(const char* name) {
+    std::cerr << "Usage: " << name
+              << " [--threshold PERCENT] [--allow-missing] [-o FILE] "
+                 "BASELINE_DIR CURRENT_DIR\n"
+                 "\n"
+                 "Compares the benchmark results (*.json written by "
+                 "jsonquery_bench with\nJSONQUERY_BENCH_JSON) in the two "
+                 "directories. Exits with 1 if a benchmark is\nmore than "
+                 "PERCENT (default 5) slower and the 95% confidence "
+                 "intervals of the\nmedians don't overlap, or if a benchmark "
+                 "of the baseline is missing from\nthe current results.\n"
+                 "\n"
+                 "  --allow-missing  only warn about missing benchmarks\n"
+                 "  -o FILE          also write the comparison as json to "
+                 "FILE\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    double threshold = 5;
+    bool allow_missing = false;
+    std::string output;
+    std::vector<std::string> directories;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "-h") == 0 ||
+                std::strcmp(argv[i], "--help") == 0) {
+                print_help(argv[0]);
+                return 0;
+            } else if (std::strcmp(argv[i], "--threshold") == 0 &&
+                       i + 1 < argc) {
+                threshold = std::stod(argv[++i]);
+            } else if (std::strcmp(argv[i], "--allow-missing") == 0) {
+                allow_missing = true;
+            } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                output = argv[++i];
+            } else {
+                directories.push_back(argv[i]);
+            }
+        }
+        if (directories.size() != 2) {
+            print_help(argv[0]);
+            return 2;
+        }
+
+        const auto baseline = load_runs(directories[0]);
+        const auto current = load_runs(directories[1]);
+
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(3)
+             << "{\"threshold_percent\":" << threshold
+             << ",\"benchmarks\":[";
+        std::size_t regressions = 0;
+        std::size_t compared = 0;
+
+        std::cout << std::left << std::setw(48) << "benchmark" << std::right
+                  << std::setw(14) << "baseline" << std::setw(14) << "current"
+                  << std::setw(10) << "change" << "\n";
+        for (const auto& [key, series] : current) {
+            const auto base = baseline.find(key);
+            std::cout << std::left << std::setw(48) << series.name
+                      << std::right;
+            if (base == baseline.end()) {
+                std::cout << std::setw(14) << "-"
+                          << std::setw(14)
+                          << format_time(median_of(series.samples))
+                          << "    (new)\n";
+                continue;
+            }
+            // (run with --benchmark-no-analysis)
+            if (series.samples.empty() || base->second.samples.empty()) {
+                std::cout << "    (no samples)\n";
+                continue;
+            }
+            const Estimate before = estimate(base->second.samples);
+            const Estimate after = estimate(series.samples);
+            const double change =
+                (after.median - before.median) / before.median * 100;
+            const bool regression =
+                change > threshold && after.low > before.high;
+            const bool improvement =
+                change < -threshold && after.high < before.low;
+            regressions += regression ? 1 : 0;
+
+            std::ostringstream percent;
+            percent << std::showpos << std::fixed << std::setprecision(1)
+                    << change << "%";
+            std::cout << std::setw(14) << format_time(before.median)
+                      << std::setw(14) << format_time(after.median)
+                      << std::setw(10) << percent.str()
+                      << (regression    ? "  REGRESSION"
+                          : improvement ? "  improvement"
+                                        : "")
+                      << "\n";
+
+            json << (compared++ == 0 ? "\n" : ",\n") << "{\"test_case\":";
+            write_string(json, series.test_case);
+            json << ",\"name\":";
+            write_string(json, series.name);
+            json << ",\"baseline\":";
+            write_estimate(json, base->second, before);
+            json << ",\"current\":";
+            write_estimate(json, series, after);
+            json << ",\"change_percent\":" << change << ",\"regression\":"
+                 << (regression ? "true" : "false") << "}";
+        }
+        json << "\n],\"missing\":[";
+
+        std::size_t missing = 0;
+        for (const auto& [key, series] : baseline) {
+            if (current.count(key) != 0) {
+                continue;
+            }
+            std::cout << std::left << std::setw(48) << series.name
+                      << std::right << std::setw(14)
+                      << (series.samples.empty()
+                              ? "-"
+                              : format_time(median_of(series.samples)))
+                      << std::setw(14) << "-" << "    (missing)\n";
+            json << (missing++ == 0 ? "\n" : ",\n") << "{\"test_case\":";
+            write_string(json, series.test_case);
+            json << ",\"name\":";
+            write_string(json, series.name);
+            json << "}";
+        }
+        json << "\n],\"regressions\":" << regressions << "}\n";
+
+        std::cout << "\n"
+                  << compared << " benchmarks compared, " << regressions
+                  << " regression" << (regressions == 1 ? "" : "s")
+                  << " above " << threshold << "%\n";
+        if (missing > 0) {
+            std::cout << missing
+                      << (missing == 1 ? " benchmark of the baseline is"
+                                       : " benchmarks of the baseline are")
+                      << " missing from the current results"
+                      << (allow_missing ? " (allowed)" : "") << "\n";
+        }
+        if (!output.empty()) {
+            std::ofstream out(output, std::ios::trunc);
+            out << json.str();
+            if (!out) {
+                throw CompareError("can't write " + output);
+            }
+        }
+        return regressions == 0 && (missing == 0 || allow_missing) ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,106 @@
+#include <catch/catch.hpp>
+
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "corpus/corpus.hpp"
+#include "selectors/selectors.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+/**
+ * File name of a shape in the corpus directory (what `make corpus` writes).
+ */
+std::string corpus_file(corpus::Shape shape) {
+    return std::string(corpus::shape_name(shape)) +
+           (shape == corpus::Shape::NDJSON ? ".ndjson" : ".json");
+}
+
+/**
+ * The input of a shape: the file in the directory JSONQUERY_CORPUS (see
+ * `make corpus`) or, without it, 1 MB generated with the default seed.
+ */
+std::string corpus_input(corpus::Shape shape) {
+    const char* dir = std::getenv("JSONQUERY_CORPUS");
+    if (dir != nullptr && *dir != '\0') {
+        return read_file((std::filesystem::path(dir) / corpus_file(shape))
+                             .string());
+    }
+    std::ostringstream out;
+    corpus::generate(out, shape, 1 << 20, 1);
+    return out.str();
+}
+
+/**
+ * A query that touches the typical part of each shape.
+ */
+std::string corpus_selector(corpus::Shape shape) {
+    switch (shape) {
+    case corpus::Shape::RECORDS:
+        return R"#([:]{"name", "age"})#";
+    case corpus::Shape::GEO:
+        return R"#("features"|"geometry")#";
+    case corpus::Shape::DEEP:
+        return R"#([:]!)#";
+    case corpus::Shape::WIDE:
+        return R"#("member1")#";
+    case corpus::Shape::ESCAPES:
+        return R"#([0:9])#";
+    case corpus::Shape::NDJSON:
+        return R"#("status")#";
+    }
+    return "";
+}
+
+std::vector<std::string> split_lines(const std::string& content) {
+    std::vector<std::string> lines;
+    std::istringstream in(content);
+    for (std::string line; std::getline(in, line);) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+} // namespace
+
+TEST_CASE("corpus: parse and query every shape", "[corpus]") {
+    for (const corpus::Shape shape : corpus::SHAPES) {
+        const std::string content = corpus_input(shape);
+        REQUIRE(!content.empty());
+        const std::string name = std::string(corpus::shape_name(shape)) +
+                                 " (" + std::to_string(content.size()) +
+                                 " bytes)";
+        const selectors::Selectors selectors =
+            selectors::parse_selectors(corpus_selector(shape));
+
+        if (shape == corpus::Shape::NDJSON) {
+            const std::vector<std::string> lines = split_lines(content);
+            BENCHMARK("parse_json " + name) {
+                std::size_t parsed = 0;
+                for (const std::string& line : lines) {
+                    parsed += json::parse_json(line).name()[0];
+                }
+                return parsed;
+            };
+            BENCHMARK("parse_json and apply " + name) {
+                std::size_t applied = 0;
+                for (const std::string& line : lines) {
+                    applied +=
+                        selectors.apply(json::parse_json(line)).name()[0];
+                }
+                return applied;
+            };
+            continue;
+        }
+
+        BENCHMARK("parse_json " + name) { return json::parse_json(content); };
+        const json::JsonNode json = json::parse_json(content);
+        BENCHMARK("apply " + name) { return selectors.apply(json); };
+    }
+}
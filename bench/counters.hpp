@@ -0,0 +1,37 @@
+#include <catch/catch.hpp>
+
+#include <string>
+#include <type_traits>
+
+#include "counters/counters.hpp"
+#include "selectors/selectors.hpp"
+#include "json/json.hpp"
+
+// Without `COUNTERS=1` the hooks must compile to nothing.
+#ifndef JSON_QUERY_COUNTERS
+static_assert(!counters::Default::enabled);
+static_assert(std::is_empty_v<counters::Disabled>);
+#endif
+
+TEST_CASE("counters: overhead of the hooks", "[counters]") {
+    const std::string content = read_file("test/generated.json");
+    const auto selectors =
+        selectors::parse_selectors(R"#([:]{"name", "age"})#");
+
+    // nothing touches the counters (with COUNTERS=1 `operator new` does)
+    if constexpr (!counters::Default::enabled) {
+        const counters::Values before = counters::totals();
+        selectors.apply(json::parse_json<counters::Disabled>(content));
+        REQUIRE(counters::totals() == before);
+    }
+
+    BENCHMARK("parse_json (counters disabled)") {
+        return json::parse_json<counters::Disabled>(content);
+    };
+    BENCHMARK("parse_json (counters per thread)") {
+        return json::parse_json<counters::PerThread>(content);
+    };
+
+    const json::JsonNode json = json::parse_json(content);
+    BENCHMARK("apply (default policy)") { return selectors.apply(json); };
+}
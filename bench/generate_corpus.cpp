@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "corpus/corpus.hpp"
+
+// jsonquery_corpus: writes a synthetic benchmark input (see corpus.hpp).
+
+namespace {
+
+void print_help(const char* name) {
+    std::cerr << "Usage: " << name
+              << " [--seed N] [-o FILE] SHAPE SIZE\n"
+                 "\n"
+                 "Writes a json document of about SIZE bytes (e.g. 512K, "
+                 "64M, 10G) to FILE or stdout.\n"
+                 "The same arguments always give the same document.\n"
+                 "\n"
+                 "Shapes:\n"
+                 "  records  array of records like test/generated.json\n"
+                 "  geo      GeoJSON polygons (mostly numbers)\n"
+                 "  deep     array of trees nested up to 64 levels\n"
+                 "  wide     one object with very many members\n"
+                 "  escapes  array of strings full of escape sequences\n"
+                 "  ndjson   log records, one document per line\n"
+                 "\n"
+                 "Options:\n"
+                 "  --seed N   seed of the random numbers (default 1)\n"
+                 "  -o FILE    write to FILE instead of stdout\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::uint64_t seed = 1;
+    std::string output;
+    std::string positional[2];
+    int num_positional = 0;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], "-h") == 0 ||
+                std::strcmp(argv[i], "--help") == 0) {
+                print_help(argv[0]);
+                return 0;
+            } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+                seed = std::stoull(argv[++i]);
+            } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                output = argv[++i];
+            } else if (num_positional < 2) {
+                positional[num_positional++] = argv[i];
+            } else {
+                throw corpus::CorpusError(std::string("unexpected argument ") +
+                                          argv[i]);
+            }
+        }
+        if (num_positional != 2) {
+            print_help(argv[0]);
+            return 1;
+        }
+
+        const corpus::Shape shape = corpus::parse_shape(positional[0]);
+        const std::uint64_t size = corpus::parse_size(positional[1]);
+        if (output.empty()) {
+            corpus::generate(std::cout, shape, size, seed);
+            std::cout.flush();
+            return std::cout ? 0 : 1;
+        }
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw corpus::CorpusError("can't open " + output);
+        }
+        corpus::generate(out, shape, size, seed);
+        out.close();
+        if (!out) {
+            throw corpus::CorpusError("can't write " + output);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch/catch.hpp>
+
+#include "reporter.hpp"
+
+#include "parser.hpp"
+#include "scheduler.hpp"
+#include "ndjson.hpp"
+#include "server.hpp"
+#include "snapshot.hpp"
+#include "counters.hpp"
+#include "perf.hpp"
+#include "scaling.hpp"
+#include "corpus.hpp"
+#include "memory.hpp"
@@ -0,0 +1,96 @@
+#include <catch/catch.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "corpus/corpus.hpp"
+#include "stats/stats.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+struct Footprint {
+    json::MemoryUsage dom;
+    // growth of the peak RSS while parsing (DOM, temporaries, allocator)
+    std::size_t peak_rss = 0;
+};
+
+std::size_t current_rss() {
+    std::ifstream statm("/proc/self/statm");
+    std::size_t size = 0;
+    std::size_t resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * Parses the input of a shape in a child process, so the peak RSS is only
+ * that of this input (it never goes down in a process).
+ */
+Footprint measure_footprint(corpus::Shape shape, const std::string& content) {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    const pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        close(fds[0]);
+        Footprint footprint;
+        const std::size_t before = current_rss();
+        std::vector<json::JsonNode> documents;
+        if (shape == corpus::Shape::NDJSON) {
+            for (const std::string& line : split_lines(content)) {
+                documents.push_back(json::parse_json(line));
+            }
+        } else {
+            documents.push_back(json::parse_json(content));
+        }
+        const std::size_t peak = stats::peak_rss();
+        footprint.peak_rss = peak > before ? peak - before : 0;
+        for (const json::JsonNode& document : documents) {
+            footprint.dom += document.memory_usage();
+        }
+        const ssize_t written = write(fds[1], &footprint, sizeof(footprint));
+        _exit(written == sizeof(footprint) ? 0 : 1);
+    }
+    close(fds[1]);
+    Footprint footprint;
+    const ssize_t read_bytes = read(fds[0], &footprint, sizeof(footprint));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    REQUIRE(read_bytes == sizeof(footprint));
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    return footprint;
+}
+
+} // namespace
+
+TEST_CASE("memory: DOM size and peak RSS per shape", "[memory]") {
+    for (const corpus::Shape shape : corpus::SHAPES) {
+        const std::string content = corpus_input(shape);
+        const Footprint footprint = measure_footprint(shape, content);
+        const json::MemoryUsage& dom = footprint.dom;
+        const std::string name = corpus::shape_name(shape);
+        const double input = static_cast<double>(content.size());
+
+        record_metric(name + " input", input, "bytes");
+        record_metric(name + " dom", dom.total(), "bytes");
+        record_metric(name + " dom per input byte", dom.total() / input,
+                      "bytes");
+        record_metric(name + " peak rss", footprint.peak_rss, "bytes");
+        record_metric(name + " peak rss per input byte",
+                      footprint.peak_rss / input, "bytes");
+        record_metric(name + " dom nodes", dom.nodes, "bytes");
+        record_metric(name + " dom strings", dom.strings, "bytes");
+        record_metric(name + " dom keys", dom.keys, "bytes");
+        record_metric(name + " dom map overhead", dom.map_overhead, "bytes");
+        record_metric(name + " dom order", dom.order, "bytes");
+        record_metric(name + " dom vector slack", dom.vector_slack, "bytes");
+    }
+}
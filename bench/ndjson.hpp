@@ -0,0 +1,57 @@
+#include <catch/catch.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "parallel/thread_pool.hpp"
+#include "selectors/selectors.hpp"
+#include "stream/lines.hpp"
+
+namespace {
+
+/**
+ * Log like records: a few small fields per line.
+ */
+std::string make_ndjson(std::size_t records) {
+    std::string s;
+    for (std::size_t i = 0; i < records; ++i) {
+        s += R"#({"ts":)#" + std::to_string(1600000000 + i) +
+             R"#(,"level":")#" + (i % 7 == 0 ? "error" : "info") +
+             R"#(","msg":"request handled","status":)#" +
+             std::to_string(200 + i % 5) + R"#(,"latency_ms":)#" +
+             std::to_string(i % 997) + R"#(.5,"tags":["a","b"]})#" + "\n";
+    }
+    return s;
+}
+
+} // namespace
+
+TEST_CASE("ndjson: throughput", "[ndjson]") {
+    const std::string input = make_ndjson(20000);
+    const auto selectors = selectors::parse_selectors(R"#({"ts","status"})#");
+
+    // divide the size by the mean time to get the throughput
+    BENCHMARK("process_lines " + std::to_string(input.size() / 1024) +
+              " KiB") {
+        std::istringstream in(input);
+        std::ostringstream out;
+        return stream::process_lines(in, out, selectors, {});
+    };
+
+    const unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    parallel::ThreadPool pool(threads - 1);
+    for (bool ordered : {true, false}) {
+        BENCHMARK("process_lines_parallel " +
+                  std::to_string(input.size() / 1024) + " KiB, " +
+                  std::to_string(threads) + " threads" +
+                  (ordered ? "" : ", unordered")) {
+            std::istringstream in(input);
+            std::ostringstream out;
+            return stream::process_lines_parallel(
+                in, out, selectors, {.pool = &pool},
+                {.chunk_size = 256 << 10, .ordered = ordered});
+        };
+    }
+}
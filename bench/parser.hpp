@@ -0,0 +1,46 @@
+#include <catch/catch.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "selectors/selectors.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+/**
+ * Reads a file relative to the repository root (run the benchmarks from
+ * there).
+ */
+std::string read_file(const std::string& path) {
+    std::ifstream ifs(path);
+    return std::string(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+TEST_CASE("parser: tiny documents", "[parser]") {
+    const std::string simple = read_file("test/simple.json");
+    const std::string selector = R"#("name")#";
+
+    BENCHMARK("parse_json simple.json") { return json::parse_json(simple); };
+
+    BENCHMARK("parse_selectors \"name\"") {
+        return selectors::parse_selectors(selector);
+    };
+
+    // what every call used to pay before the grammars were reused
+    typedef boost::spirit::line_pos_iterator<std::string::const_iterator>
+        Iterator;
+    // (the grammars overload `operator&` so they can't be returned directly)
+    BENCHMARK("construct json_grammar") {
+        json::json_grammar<Iterator> grammar;
+        return grammar.name().size();
+    };
+    BENCHMARK("construct selectors_grammar") {
+        selectors::selectors_grammar<std::string::const_iterator> grammar;
+        return grammar.name().size();
+    };
+}
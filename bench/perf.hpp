@@ -0,0 +1,66 @@
+#include <catch/catch.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "perf/perf.hpp"
+#include "selectors/selectors.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+/**
+ * Runs `f` `iterations` times and prints the wall time and the hardware
+ * counters per iteration.
+ */
+template <typename F>
+void perf_phase(perf::Counters& counters, const char* name, int iterations,
+                F&& f) {
+    f(); // warmup
+    const auto start = std::chrono::steady_clock::now();
+    const perf::Sample sample = perf::measure(counters, [&f, iterations] {
+        for (int i = 0; i < iterations; ++i) {
+            f();
+        }
+    });
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    std::cout << "perf: " << name << ": " << seconds * 1e3 / iterations
+              << " ms ";
+    perf::print(std::cout, sample.per(iterations));
+    std::cout << std::endl;
+}
+
+} // namespace
+
+TEST_CASE("perf: hardware counters of the phases", "[perf]") {
+    perf::Counters counters;
+    if (!counters.available()) {
+        // still print the timings, the counters are n/a
+        std::cout << "perf: no hardware counters (" << counters.reason()
+                  << ")" << std::endl;
+    } else if (!counters.reason().empty()) {
+        std::cout << "perf: " << counters.reason() << std::endl;
+    }
+
+    const std::string content = read_file("test/generated.json");
+    const std::string selector = R"#([:]{"name", "friends"}, [:]"tags")#";
+    const selectors::Selectors selectors =
+        selectors::parse_selectors(selector);
+    const json::JsonNode json = json::parse_json(content);
+    const json::JsonNode result = selectors.apply(json);
+
+    perf_phase(counters, "parse_json", 20,
+               [&content] { json::parse_json(content); });
+    perf_phase(counters, "parse_selectors", 200,
+               [&selector] { selectors::parse_selectors(selector); });
+    perf_phase(counters, "apply", 200,
+               [&selectors, &json] { selectors.apply(json); });
+    perf_phase(counters, "serialize", 200, [&result] {
+        std::ostringstream out;
+        out << result;
+    });
+}
@@ -0,0 +1,152 @@
+#include <catch/catch.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * A measurement that isn't a time (e.g. a size), written next to the
+ * benchmarks by the JsonListener.
+ */
+struct Metric {
+    std::string name;
+    double value;
+    const char* unit;
+};
+
+std::vector<Metric>& metrics() {
+    static std::vector<Metric> metrics;
+    return metrics;
+}
+
+/**
+ * Records a metric for the json results (and prints it).
+ */
+void record_metric(const std::string& name, double value, const char* unit) {
+    std::cout << "metric: " << name << ": " << std::fixed
+              << std::setprecision(2) << value << ' ' << unit << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    metrics().push_back(Metric{name, value, unit});
+}
+
+/**
+ * Writes the results of all benchmarks as one json document to the file in
+ * the environment variable JSONQUERY_BENCH_JSON (if it is set) so runs can
+ * be compared by scripts. The console output stays as it is.
+ *
+ * All times are in nanoseconds per iteration:
+ *
+ *     {"version":1,"benchmarks":[{"test_case":"...","name":"...",
+ *      "samples":100,"iterations":1,"mean_ns":..,"mean_low_ns":..,
+ *      "mean_high_ns":..,"confidence_interval":0.95,"std_dev_ns":..,
+ *      "median_ns":..,"samples_ns":[..]},...],
+ *      "metrics":[{"name":"...","value":..,"unit":"..."},...]}
+ */
+class JsonListener : public Catch::TestEventListenerBase {
+    struct Result {
+        std::string test_case;
+        Catch::BenchmarkStats<> stats;
+    };
+
+    std::vector<Result> results;
+
+    static void write_string(std::ostream& o, const std::string& s) {
+        o << '"';
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                o << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                o << escaped;
+            } else {
+                o << c;
+            }
+        }
+        o << '"';
+    }
+
+    static void write_result(std::ostream& o, const Result& result) {
+        const Catch::BenchmarkStats<>& stats = result.stats;
+        std::vector<double> samples;
+        for (const auto& sample : stats.samples) {
+            samples.push_back(sample.count());
+        }
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        double median = 0;
+        if (!sorted.empty()) {
+            const std::size_t mid = sorted.size() / 2;
+            median = sorted.size() % 2 == 1
+                         ? sorted[mid]
+                         : (sorted[mid - 1] + sorted[mid]) / 2;
+        }
+
+        o << "{\"test_case\":";
+        write_string(o, result.test_case);
+        o << ",\"name\":";
+        write_string(o, stats.info.name);
+        o << ",\"samples\":" << stats.info.samples
+          << ",\"iterations\":" << stats.info.iterations
+          << ",\"mean_ns\":" << stats.mean.point.count()
+          << ",\"mean_low_ns\":" << stats.mean.lower_bound.count()
+          << ",\"mean_high_ns\":" << stats.mean.upper_bound.count()
+          << ",\"confidence_interval\":" << stats.mean.confidence_interval
+          << ",\"std_dev_ns\":" << stats.standardDeviation.point.count()
+          << ",\"median_ns\":" << median << ",\"samples_ns\":[";
+        for (std::size_t i = 0; i < samples.size(); ++i) {
+            o << (i == 0 ? "" : ",") << samples[i];
+        }
+        o << "]}";
+    }
+
+public:
+    using TestEventListenerBase::TestEventListenerBase;
+
+    void benchmarkEnded(Catch::BenchmarkStats<> const& stats) override {
+        results.push_back(
+            {currentTestCaseInfo.some() ? currentTestCaseInfo->name : "",
+             stats});
+    }
+
+    void testRunEnded(Catch::TestRunStats const& stats) override {
+        TestEventListenerBase::testRunEnded(stats);
+        const char* path = std::getenv("JSONQUERY_BENCH_JSON");
+        if (path == nullptr || *path == '\0') {
+            return;
+        }
+        std::ofstream out(path, std::ios::trunc);
+        // fixed: the json parser doesn't support exponents with a "+"
+        out << std::fixed << std::setprecision(3)
+            << "{\"version\":1,\"benchmarks\":[";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            out << (i == 0 ? "\n" : ",\n");
+            write_result(out, results[i]);
+        }
+        out << "\n],\"metrics\":[";
+        for (std::size_t i = 0; i < metrics().size(); ++i) {
+            const Metric& metric = metrics()[i];
+            out << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+            write_string(out, metric.name);
+            out << ",\"value\":" << metric.value << ",\"unit\":";
+            write_string(out, metric.unit);
+            out << "}";
+        }
+        out << "\n]}\n";
+        if (!out) {
+            std::cerr << "can't write benchmark results to " << path
+                      << std::endl;
+        }
+    }
+};
+
+} // namespace
+
+CATCH_REGISTER_LISTENER(JsonListener)
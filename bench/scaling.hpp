@@ -0,0 +1,148 @@
+#include <catch/catch.hpp>
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "selectors/selectors.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+constexpr std::size_t KB = 1024;
+constexpr std::size_t GB = KB * KB * KB;
+
+/**
+ * Document sizes of the scaling benchmarks: from 1 KB up to the size in the
+ * environment variable JSONQUERY_BENCH_MAX_SIZE in bytes (default 4 MB, at
+ * most 1 GB) in steps of 16x. A document is parsed into a DOM several times
+ * its size, so only raise the limit on a machine with the memory for it.
+ */
+std::vector<std::size_t> bench_sizes() {
+    std::size_t max = 4 * KB * KB;
+    if (const char* env = std::getenv("JSONQUERY_BENCH_MAX_SIZE")) {
+        max = std::min<std::size_t>(std::strtoull(env, nullptr, 10), GB);
+    }
+    std::vector<std::size_t> sizes;
+    for (std::size_t size = KB; size <= max; size *= 16) {
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+std::string size_name(std::size_t bytes) {
+    const char* units[] = {"B", "KB", "MB", "GB"};
+    std::size_t unit = 0;
+    while (bytes >= KB && bytes % KB == 0 && unit < 3) {
+        bytes /= KB;
+        ++unit;
+    }
+    return std::to_string(bytes) + units[unit];
+}
+
+/**
+ * About `bytes` of records (every selector overload has something to work
+ * on): {"meta":{...},"records":[{"id":0,"name":"...",...},...]}
+ */
+std::string make_records(std::size_t bytes) {
+    std::string s = R"#({"meta":{"version":1,"source":"bench"},"records":[)#";
+    for (std::size_t i = 0; s.size() < bytes; ++i) {
+        const std::string id = std::to_string(i);
+        s += (i == 0 ? "" : ",");
+        s += R"#({"id":)#" + id + R"#(,"name":"record )#" + id +
+             R"#(","active":)#" + (i % 3 == 0 ? "true" : "false") +
+             R"#(,"score":)#" + std::to_string(i % 1000) +
+             R"#(.25,"tags":["a","b","c"],"address":{"city":"city )#" + id +
+             R"#(","zip":")#" + std::to_string(10000 + i % 90000) +
+             R"#("}})#";
+    }
+    return s + "]}";
+}
+
+/**
+ * One object with about `bytes` of members {"key0":0,"key1":1,...}. Returns
+ * the number of members in `members`.
+ */
+std::string make_wide_object(std::size_t bytes, std::size_t& members) {
+    std::string s = "{";
+    for (members = 0; s.size() < bytes; ++members) {
+        const std::string i = std::to_string(members);
+        s += (members == 0 ? "\"key" : ",\"key") + i + "\":" + i;
+    }
+    return s + "}";
+}
+
+} // namespace
+
+TEST_CASE("scaling: parse and serialize", "[scaling]") {
+    for (const std::size_t size : bench_sizes()) {
+        const std::string content = make_records(size);
+        const std::string name = size_name(size);
+
+        BENCHMARK("parse_json " + name) { return json::parse_json(content); };
+
+        const json::JsonNode json = json::parse_json(content);
+        BENCHMARK("serialize " + name) {
+            std::ostringstream out;
+            out << json;
+            return out.str().size();
+        };
+    }
+}
+
+TEST_CASE("scaling: apply_selector overloads", "[scaling]") {
+    // one selector per overload (the ones in front only navigate there)
+    const std::vector<std::pair<std::string, std::string>> overloads = {
+        {"KeySelector", R"#("meta")#"},
+        {"AnyRootSelector", R"#(."meta")#"},
+        {"IndexSelector", R"#("records"[0])#"},
+        {"RangeSelector", R"#("records"[:]"id")#"},
+        {"PropertySelector", R"#("records"[:]{"id", "score"})#"},
+        {"FilterSelector", R"#("records"|"name")#"},
+        {"FlattenSelector", R"#("records"|"tags"..)#"},
+        {"TruncateSelector", R"#("records"[:]!)#"},
+    };
+
+    for (const std::size_t size : bench_sizes()) {
+        const json::JsonNode json = json::parse_json(make_records(size));
+        for (const auto& [overload, selector] : overloads) {
+            const selectors::Selectors selectors =
+                selectors::parse_selectors(selector);
+            BENCHMARK("apply " + overload + " " + size_name(size)) {
+                return selectors.apply(json);
+            };
+        }
+    }
+}
+
+TEST_CASE("scaling: JsonObject::find", "[scaling]") {
+    for (const std::size_t size : bench_sizes()) {
+        std::size_t members = 0;
+        const json::JsonNode json =
+            json::parse_json(make_wide_object(size, members));
+        const json::JsonObject& object = json.as<json::JsonObject>();
+        const std::string present = "key" + std::to_string(members / 2);
+        const std::string missing = "missing";
+
+        BENCHMARK("JsonObject::find hit " + size_name(size)) {
+            return object.find(present);
+        };
+        BENCHMARK("JsonObject::find miss " + size_name(size)) {
+            return object.find(missing);
+        };
+    }
+}
+
+TEST_CASE("scaling: parse_selectors", "[scaling]") {
+    for (const std::size_t roots : {1, 16, 256}) {
+        std::string selector;
+        for (std::size_t i = 0; i < roots; ++i) {
+            selector += (i == 0 ? "" : ", ");
+            selector += R"#("records"[:]{"id", "name"}|"tags"..)#";
+        }
+        BENCHMARK("parse_selectors " + std::to_string(roots) + " roots") {
+            return selectors::parse_selectors(selector);
+        };
+    }
+}
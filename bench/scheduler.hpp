@@ -0,0 +1,176 @@
+#include <catch/catch.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel/thread_pool.hpp"
+
+namespace {
+
+/**
+ * The most naive pool possible: one queue behind one mutex. Used as the
+ * baseline for the work stealing ThreadPool.
+ */
+class MutexQueuePool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+
+public:
+    explicit MutexQueuePool(std::size_t num_workers) {
+        for (std::size_t i = 0; i < num_workers; ++i) {
+            workers.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock lock(mutex);
+                        available.wait(lock, [this] {
+                            return stopping || !tasks.empty();
+                        });
+                        if (tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~MutexQueuePool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /**
+     * Runs `body(i)` for all `i` in `[0, n)` as separate tasks and waits for
+     * them.
+     */
+    template <typename Body> void run_all(std::size_t n, const Body& body) {
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        std::size_t done = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            {
+                std::lock_guard lock(mutex);
+                tasks.emplace_back([&, i] {
+                    body(i);
+                    std::lock_guard done_lock(done_mutex);
+                    if (++done == n) {
+                        done_cv.notify_one();
+                    }
+                });
+            }
+            available.notify_one();
+        }
+        std::unique_lock lock(done_mutex);
+        done_cv.wait(lock, [&] { return done == n; });
+    }
+};
+
+std::size_t num_threads() {
+    return std::max(2u, std::thread::hardware_concurrency());
+}
+
+// some work that the compiler can't optimize away
+std::size_t work(std::size_t begin, std::size_t end) {
+    std::size_t x = 0;
+    for (std::size_t i = begin; i < end; ++i) {
+        x = x * 31 + (i ^ (x >> 7));
+    }
+    return x;
+}
+
+constexpr std::size_t ITEMS = 1 << 22;
+
+} // namespace
+
+TEST_CASE("scheduler: coarse tasks", "[scheduler]") {
+    const std::size_t chunks = 256;
+    const std::size_t chunk_size = ITEMS / chunks;
+
+    BENCHMARK("serial") { return work(0, ITEMS); };
+
+    parallel::ThreadPool pool(num_threads() - 1);
+    BENCHMARK("ThreadPool parallel_reduce") {
+        return parallel::parallel_reduce(
+            &pool, ITEMS, chunk_size, std::size_t{0}, work,
+            [](std::size_t a, std::size_t b) { return a ^ b; });
+    };
+
+    BENCHMARK("std::async") {
+        std::vector<std::future<std::size_t>> futures;
+        for (std::size_t c = 0; c < chunks; ++c) {
+            futures.push_back(std::async(std::launch::async, work,
+                                         c * chunk_size,
+                                         (c + 1) * chunk_size));
+        }
+        std::size_t x = 0;
+        for (auto& f : futures) {
+            x ^= f.get();
+        }
+        return x;
+    };
+
+    MutexQueuePool naive(num_threads());
+    BENCHMARK("mutex queue") {
+        std::vector<std::size_t> results(chunks);
+        naive.run_all(chunks, [&results, chunk_size](std::size_t c) {
+            results[c] = work(c * chunk_size, (c + 1) * chunk_size);
+        });
+        std::size_t x = 0;
+        for (std::size_t r : results) {
+            x ^= r;
+        }
+        return x;
+    };
+}
+
+TEST_CASE("scheduler: tiny tasks", "[scheduler]") {
+    const std::size_t tasks = 10000;
+
+    parallel::ThreadPool pool(num_threads() - 1);
+    BENCHMARK("ThreadPool parallel_for") {
+        std::vector<std::size_t> results(tasks);
+        parallel::parallel_for(&pool, tasks, [&results](std::size_t i) {
+            results[i] = work(i, i + 16);
+        });
+        return results.back();
+    };
+
+    BENCHMARK("ThreadPool nested parallel_for") {
+        std::vector<std::size_t> results(tasks);
+        parallel::parallel_for(&pool, 100, [&](std::size_t i) {
+            parallel::parallel_for(&pool, tasks / 100, [&](std::size_t j) {
+                const std::size_t k = i * (tasks / 100) + j;
+                results[k] = work(k, k + 16);
+            });
+        });
+        return results.back();
+    };
+
+    MutexQueuePool naive(num_threads());
+    BENCHMARK("mutex queue") {
+        std::vector<std::size_t> results(tasks);
+        naive.run_all(tasks, [&results](std::size_t i) {
+            results[i] = work(i, i + 16);
+        });
+        return results.back();
+    };
+}
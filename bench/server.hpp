@@ -0,0 +1,64 @@
+#include <catch/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "parallel/thread_pool.hpp"
+#include "server/document.hpp"
+#include "server/server.hpp"
+#include "json/json.hpp"
+
+// Not a Catch BENCHMARK: the interesting numbers are the latency percentiles
+// of the load generator, with and without the document being reloaded in
+// the background all the time. They should be about the same.
+TEST_CASE("server: query latency while reloading", "[server]") {
+    // ~256 KiB
+    const std::string generated = read_file("test/generated.json");
+    std::string content = "[";
+    for (int i = 0; i < 4; ++i) {
+        content += (i == 0 ? "" : ",") + generated;
+    }
+    content += "]";
+
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_bench.sock")
+            .string();
+    server::Document document(json::parse_json(content));
+    parallel::ThreadPool pool(4);
+    server::Server server(document, path, {.pool = &pool});
+    std::thread serving([&server] { server.serve(); });
+
+    auto report = [](const char* name, const server::LoadStats& stats) {
+        auto micros = [](std::chrono::nanoseconds duration) {
+            return std::chrono::duration<double, std::micro>(duration)
+                .count();
+        };
+        std::cout << name << ": " << stats.requests / stats.seconds
+                  << " requests/s, p50 " << micros(stats.p50) << " us, p99 "
+                  << micros(stats.p99) << " us, max " << micros(stats.max)
+                  << " us\n";
+    };
+
+    const std::string selector = R"#([3][0]."friends"[1])#";
+    report("idle", server::run_load(path, selector, 4, 50000));
+
+    std::atomic<bool> loading = true;
+    std::size_t reloads = 0;
+    std::thread reloader([&] {
+        while (loading) {
+            document.replace(json::parse_json(content));
+            ++reloads;
+        }
+    });
+    report("reloading", server::run_load(path, selector, 4, 50000));
+    loading = false;
+    reloader.join();
+    std::cout << "(" << reloads << " reloads)\n";
+
+    server.stop();
+    serving.join();
+}
@@ -0,0 +1,35 @@
+#include <catch/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "selectors/selectors.hpp"
+#include "snapshot/snapshot.hpp"
+#include "json/json.hpp"
+
+TEST_CASE("snapshot: load and query", "[snapshot]") {
+    const std::string content = read_file("test/generated.json");
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_bench.jqs")
+            .string();
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        snapshot::write_snapshot(json::parse_json(content), out);
+    }
+    const auto selectors = selectors::parse_selectors(R"#([3]."friends"[1])#");
+
+    BENCHMARK("parse json and query") {
+        return selectors.apply(json::parse_json(content));
+    };
+
+    BENCHMARK("map snapshot and query") {
+        const snapshot::Snapshot snapshot(path);
+        return snapshot::apply(selectors, snapshot, {});
+    };
+
+    BENCHMARK("map snapshot and decode everything") {
+        const snapshot::Snapshot snapshot(path);
+        return snapshot.root().decode();
+    };
+}
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+
+# A/B benchmark gate: builds jsonquery_bench of a baseline git ref and of the
+# current tree (including uncommitted changes) in temporary directories, so
+# the builds in the tree itself are left alone, runs both REPETITIONS times
+# (alternating, so drift of the machine hits both the same) and compares
+# them with jsonquery_bench_compare. Exits with 1 if a benchmark regressed by
+# more than THRESHOLD percent or a benchmark of the baseline is missing from
+# the current tree.
+#
+# Usage: ./bench_compare.sh [BASELINE_REF] [CATCH2 ARGUMENTS...]
+#
+#     ./bench_compare.sh main '[scaling]'
+#     REPETITIONS=10 THRESHOLD=3 ./bench_compare.sh HEAD~1 '[parser]'
+#
+# Everything goes to benchmarks/<date>-<ref>/: the result of every run (json
+# written by jsonquery_bench, see bench/reporter.hpp) and compare.json. The
+# baseline has to be a commit that already writes json results
+# (JSONQUERY_BENCH_JSON).
+
+set -euo pipefail
+
+BASELINE_REF=${1:-HEAD}
+shift || true
+BENCH_ARGS=("$@")
+REPETITIONS=${REPETITIONS:-5}
+THRESHOLD=${THRESHOLD:-5}
+SAMPLES=${SAMPLES:-20}
+MAKE_ARGS=(RELEASE=1 ${CXX:+CXX=$CXX} ${CXXFLAGS:+CXXFLAGS=$CXXFLAGS})
+
+baseline_commit=$(git rev-parse --short "$BASELINE_REF^{commit}")
+run_dir="benchmarks/$(date +%Y%m%d-%H%M%S)-$baseline_commit"
+mkdir -p "$run_dir/baseline" "$run_dir/current"
+
+worktree=$(mktemp -d)
+current=$(mktemp -d)
+trap 'git worktree remove --force "$worktree" >/dev/null 2>&1 || true; rm -rf "$worktree" "$current"' EXIT
+
+echo "> Building baseline $BASELINE_REF ($baseline_commit)"
+git worktree add --detach "$worktree" "$baseline_commit" >/dev/null
+make -C "$worktree" "${MAKE_ARGS[@]}" jsonquery_bench
+
+# a copy of the files git knows about (tracked or not ignored), without the
+# objects of earlier builds in the tree
+echo "> Building current tree"
+git ls-files -z --cached --others --exclude-standard |
+    tar --null --files-from=- --ignore-failed-read -cf - 2>/dev/null |
+    tar -xf - -C "$current"
+make -C "$current" "${MAKE_ARGS[@]}" jsonquery_bench jsonquery_bench_compare
+
+# both run in the current tree (same test files and corpus)
+for i in $(seq 1 "$REPETITIONS"); do
+    echo "> Run $i/$REPETITIONS"
+    JSONQUERY_BENCH_JSON="$run_dir/baseline/run-$i.json" \
+        "$worktree/jsonquery_bench" --benchmark-samples "$SAMPLES" \
+        "${BENCH_ARGS[@]}" >/dev/null
+    JSONQUERY_BENCH_JSON="$run_dir/current/run-$i.json" \
+        "$current/jsonquery_bench" --benchmark-samples "$SAMPLES" \
+        "${BENCH_ARGS[@]}" >/dev/null
+done
+
+if [ ! -s "$run_dir/baseline/run-1.json" ]; then
+    echo "The baseline $BASELINE_REF doesn't write json results (too old)"
+    exit 2
+fi
+
+status=0
+"$current/jsonquery_bench_compare" --threshold "$THRESHOLD" \
+    -o "$run_dir/compare.json" "$run_dir/baseline" "$run_dir/current" ||
+    status=$?
+
+echo "> Results are in $run_dir"
+exit $status
@@ -66,4 +66,20 @@ hyperfine \
 
 append_result "generated"
 
+# scaling of the parallel evaluation of independent root selectors with the
+# number of threads (from 1 to the number of cores)
+MAX_THREADS=$(nproc)
+ROOT_SELECTORS='|"friends",|"tags",|"name",|"email",|"address",|"about",|"registered",|"greeting"'
+
+hyperfine \
+    --warmup 5 \
+    --parameter-scan threads 1 "$MAX_THREADS" \
+    --export-markdown benchmarks/threads.md \
+    "./jsonquery --threads {threads} '$ROOT_SELECTORS' test/generated.json"
+
+echo "# threads (generated.json)" >> "$RESULT_FILE"
+echo >> "$RESULT_FILE"
+cat benchmarks/threads.md >> "$RESULT_FILE"
+echo >> "$RESULT_FILE"
+
 echo "> Results are in $RESULT_FILE"
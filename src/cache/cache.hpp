@@ -0,0 +1,350 @@
+#ifndef JSON_QUERY_CACHE_CACHE_HPP
+#define JSON_QUERY_CACHE_CACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../selectors/selectors.hpp"
+
+// On-disk cache of query results.
+//
+// Every result is one file `<hash of key>.cache` in the cache directory. It
+// starts with the key (so hash collisions are detected) followed by the
+// output exactly as it was written. The modification time of an entry is
+// its last use, which the eviction uses to remove the least recently used
+// entries first.
+namespace cache {
+
+/**
+ * The cache directory can't be used.
+ */
+class CacheError : public std::exception {
+    std::string what_;
+
+public:
+    CacheError(const std::string& message) : what_(message) {}
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+constexpr std::string_view SUFFIX = ".cache";
+// marks the temporary files entries are written to before they are renamed
+constexpr std::string_view TMP_INFIX = ".tmp.";
+// temporary files older than this were left behind by a process that died
+// before renaming them
+constexpr auto STALE_TMP_AGE = std::chrono::minutes(10);
+
+/**
+ * 64 bit FNV-1a, continues from `hash`.
+ */
+std::uint64_t fnv1a(std::string_view data,
+                    std::uint64_t hash = 0xcbf29ce484222325) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * Hash of the content of a file.
+ *
+ * @throws CacheError if the file can't be read
+ */
+std::uint64_t hash_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw CacheError("can't open " + path);
+    }
+    std::uint64_t hash = fnv1a("");
+    std::vector<char> buffer(1 << 16);
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        hash = fnv1a(std::string_view(buffer.data(), in.gcount()), hash);
+    }
+    return hash;
+}
+
+namespace detail {
+
+/**
+ * Writes a string with its length in front, so no content of the string can
+ * be mistaken for the structure around it.
+ */
+void write_string(std::ostream& out, const std::string& s) {
+    out << s.size() << ':' << s;
+}
+
+template <typename Selector>
+void write_selector(std::ostream& out, const Selector& /*unused*/) {
+    out << Selector::name();
+}
+
+void write_selector(std::ostream& out, const selectors::KeySelector& s) {
+    out << s.name() << ' ';
+    write_string(out, s.get());
+}
+
+void write_selector(std::ostream& out, const selectors::IndexSelector& s) {
+    out << s.name() << ' ' << s.get();
+}
+
+void write_selector(std::ostream& out, const selectors::RangeSelector& s) {
+    out << s.name() << ' ';
+    if (s.get_start()) {
+        out << *s.get_start();
+    }
+    out << ':';
+    if (s.get_end()) {
+        out << *s.get_end();
+    }
+}
+
+void write_selector(std::ostream& out, const selectors::PropertySelector& s) {
+    out << s.name() << ' ' << s.get_keys().size();
+    for (const std::string& key : s.get_keys()) {
+        out << ' ';
+        write_string(out, key);
+    }
+}
+
+void write_selector(std::ostream& out, const selectors::FilterSelector& s) {
+    out << s.name() << ' ';
+    write_string(out, s.get().get());
+}
+
+} // namespace detail
+
+/**
+ * Selectors in a canonical form: whitespace and the way they were written
+ * don't matter. Keys are length prefixed, so different selectors never give
+ * the same text.
+ */
+std::string normalize(const selectors::Selectors& selectors) {
+    std::ostringstream out;
+    out << selectors.get().size();
+    for (const selectors::RootSelector& root : selectors.get()) {
+        out << " (" << root.get().size();
+        for (const selectors::SelectorNode& node : root.get()) {
+            out << ' ';
+            boost::apply_visitor(
+                [&out](const auto& s) { detail::write_selector(out, s); },
+                node.inner);
+        }
+        out << ')';
+    }
+    return out.str();
+}
+
+/**
+ * Identifies a result: the version of the input file (device, inode, size
+ * and modification time, optionally the hash of the content) and the
+ * selectors.
+ *
+ * Without the content hash a file that is changed without changing its size
+ * and modification time is not noticed, with it the file has to be read
+ * (but not parsed) on every query.
+ *
+ * @throws CacheError if the file does not exist
+ */
+std::string make_key(const std::string& file,
+                     const selectors::Selectors& selectors, bool hash_content) {
+    struct stat info;
+    if (stat(file.c_str(), &info) < 0) {
+        throw CacheError("can't stat " + file);
+    }
+    std::ostringstream key;
+    key << "jsonquery cache 2\n"
+        << "file " << info.st_dev << ' ' << info.st_ino << ' '
+        << info.st_size << ' ' << info.st_mtim.tv_sec << '.'
+        << std::setw(9) << std::setfill('0') << info.st_mtim.tv_nsec << '\n'
+        << "hash ";
+    if (hash_content) {
+        key << std::hex << hash_file(file) << std::dec;
+    } else {
+        key << '-';
+    }
+    key << "\nselectors " << normalize(selectors) << '\n';
+    return key.str();
+}
+
+/**
+ * Result cache in a directory that is limited to `limit` bytes.
+ *
+ * Many processes can use the same directory at the same time: entries are
+ * written to a temporary file and renamed, so readers see either the whole
+ * entry or none. If two processes store the same entry the last one wins
+ * (both are the same result anyway).
+ */
+class ResultCache {
+    std::filesystem::path directory;
+    std::uintmax_t limit;
+    // size of the entries at the last scan plus what was stored since (by
+    // this object, other processes can store more meanwhile)
+    std::optional<std::uintmax_t> estimate;
+
+    std::filesystem::path entry_path(const std::string& key) const {
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << fnv1a(key)
+             << SUFFIX;
+        return directory / name.str();
+    }
+
+public:
+    /**
+     * Creates the directory if it doesn't exist yet.
+     *
+     * @throws CacheError if the directory can't be created
+     */
+    ResultCache(const std::string& directory, std::uintmax_t limit)
+        : directory(directory), limit(limit) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (error) {
+            throw CacheError("can't create cache directory " + directory +
+                             ": " + error.message());
+        }
+    }
+
+    /**
+     * Writes the stored result for `key` to `out`. Returns false if there
+     * is none.
+     */
+    bool load(const std::string& key, std::ostream& out) const {
+        const std::filesystem::path path = entry_path(key);
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        std::string stored(key.size(), '\0');
+        if (!in.read(stored.data(), stored.size()) || stored != key) {
+            return false;
+        }
+        // mark as recently used
+        std::error_code error;
+        std::filesystem::last_write_time(
+            path, std::filesystem::file_time_type::clock::now(), error);
+
+        // an empty result (can't happen for json) would set the failbit
+        if (in.peek() != std::char_traits<char>::eof()) {
+            out << in.rdbuf();
+        }
+        return true;
+    }
+
+    /**
+     * Stores the result for `key` and then evicts the least recently used
+     * entries if the cache might not fit into its limit anymore. Failing to
+     * store is not an error (the result just isn't cached).
+     *
+     * The directory is only scanned by the first store and when the
+     * estimated size is over the limit.
+     */
+    void store(const std::string& key, std::string_view output) {
+        static std::atomic<unsigned> counter{0};
+        const std::filesystem::path path = entry_path(key);
+        const std::filesystem::path tmp =
+            path.string() + std::string(TMP_INFIX) + std::to_string(getpid()) +
+            "." + std::to_string(counter++);
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out << key << output;
+            if (!out) {
+                out.close();
+                std::error_code error;
+                std::filesystem::remove(tmp, error);
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tmp, path, error);
+        if (error) {
+            std::filesystem::remove(tmp, error);
+            return;
+        }
+        if (estimate) {
+            *estimate += key.size() + output.size();
+        }
+        if (!estimate || *estimate > limit) {
+            evict();
+        }
+    }
+
+    /**
+     * Removes the least recently used entries until the total size of the
+     * entries is at most the limit. Also removes stale temporary files.
+     */
+    void evict() {
+        struct Entry {
+            std::filesystem::path path;
+            std::filesystem::file_time_type used;
+            std::uintmax_t size;
+        };
+        std::vector<Entry> entries;
+        std::uintmax_t total = 0;
+        const auto now = std::filesystem::file_time_type::clock::now();
+        std::error_code error;
+        for (const auto& file :
+             std::filesystem::directory_iterator(directory, error)) {
+            const std::string name = file.path().filename().string();
+            const bool tmp = name.find(TMP_INFIX) != std::string::npos;
+            if (!tmp && !name.ends_with(SUFFIX)) {
+                continue;
+            }
+            std::error_code entry_error;
+            const std::uintmax_t size = file.file_size(entry_error);
+            const auto used = file.last_write_time(entry_error);
+            // removed by another process meanwhile
+            if (entry_error) {
+                continue;
+            }
+            if (tmp) {
+                // younger ones are still being written
+                if (now - used > STALE_TMP_AGE) {
+                    std::filesystem::remove(file.path(), entry_error);
+                }
+                continue;
+            }
+            entries.push_back(Entry{file.path(), used, size});
+            total += size;
+        }
+        estimate = total;
+        if (total <= limit) {
+            return;
+        }
+
+        std::sort(
+            entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (const Entry& entry : entries) {
+            if (total <= limit) {
+                break;
+            }
+            std::filesystem::remove(entry.path, error);
+            total -= entry.size;
+        }
+        estimate = total;
+    }
+};
+
+} // namespace cache
+
+#endif
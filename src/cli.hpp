@@ -1,8 +1,11 @@
 #include <cstring>
 #include <exception>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace cli {
 
@@ -15,24 +18,162 @@ struct Arguments {
     bool help = false;
     bool only_parse = false;
     bool debug = false;
+    // input is newline delimited json (one document per line)
+    bool lines = false;
+    // input is a sequence of concatenated json documents
+    bool stream = false;
+    // with --lines and --threads: write results as soon as they are done
+    bool unordered = false;
+    // number of threads for everything that runs in parallel (0 means one per
+    // core)
+    unsigned threads = 1;
+    bool pin_threads = false;
+    // file with the names of the input files (one per line)
+    std::optional<std::string> files_from;
+    // prefix the results with the name of the file
+    bool with_filename = false;
+    // file with many selectors (one per line) to apply to the same document
+    std::optional<std::string> queries_from;
+    // with --queries-from: write every result to its own file in this
+    // directory
+    std::optional<std::string> output_dir;
+    // socket to answer queries on (the json stays in memory)
+    std::optional<std::string> serve;
+    // socket of a running --serve to send the selectors to
+    std::optional<std::string> connect;
+    // with --connect: number of connections and requests of the load test
+    unsigned clients = 1;
+    unsigned requests = 1;
+    // the two files are the input json and the snapshot to write
+    bool build_snapshot = false;
+    // build the sidecar index of the file (used by later queries on it)
+    bool build_index = false;
+    // with --build-index: number of nesting levels that are indexed
+    unsigned index_depth = 1;
+    // directory to cache the results of queries on files in
+    std::optional<std::string> cache_dir;
+    // with --cache-dir: the content of the file is part of the key
+    bool cache_hash = false;
+    // with --cache-dir: size limit of the cache in MiB
+    std::size_t cache_limit = 256;
+    // print phase timings, sizes and memory usage to stderr (as json)
+    bool stats = false;
+    bool stats_json = false;
+    // file to write a Chrome trace of the run to
+    std::optional<std::string> trace;
+    // print the selectors as a plan tree instead of applying them
+    bool explain = false;
+    // apply the selectors and print the plan tree with the counters
+    bool explain_analyze = false;
     std::string selector;
-    std::optional<std::string> file;
+    std::vector<std::string> files;
+
+    /**
+     * The single input file (nothing means stdin). Only meaningful if not
+     * batch().
+     */
+    std::optional<std::string> file() const {
+        if (files.empty()) {
+            return std::nullopt;
+        }
+        return files.front();
+    }
+
+    /**
+     * Whether many files are processed (more than one file or --files-from).
+     */
+    bool batch() const {
+        return !build_snapshot && !build_index &&
+               (files.size() > 1 || files_from.has_value());
+    }
 };
 
 void print_help(const char* name) {
     std::cerr
         << "Usage: " << name
-        << " [--help] [--only-parse] [--debug] <selectors> [file]"
+        << " [--help] [--only-parse] [--debug] [--lines] [--stream] "
+           "[--unordered] "
+           "[--threads N] "
+           "[--pin-threads] [--files-from FILE] [--with-filename] "
+           "[--queries-from FILE [--output-dir DIR]] [--serve SOCKET] "
+           "[--connect SOCKET [--clients N] [--requests N]] "
+           "[--build-snapshot <json> <snapshot>] "
+           "[--build-index <json> [--index-depth N]] "
+           "[--cache-dir DIR [--cache-hash] [--cache-limit MIB]] "
+           "[--stats] [--stats-json] [--trace FILE] "
+           "[--explain] [--explain-analyze] "
+           "<selectors> [file...]"
         << "\n\n"
         << "ARGS:" << std::endl
-        << "\t<selectors>\tQuery selectors to apply\n"
-        << "\t<file>\t\tJson file to use (if not given stdin will be used)\n"
+        << "\t<selectors>\tQuery selectors to apply (not given with "
+           "--queries-from and --serve)\n"
+        << "\t<file>\t\tJson file (or snapshot) to use (if not given stdin "
+           "will be used). "
+           "With more than one file every file is queried separately and "
+           "the results are written one per line in the order of the files\n"
         << "\n"
         << "OPTIONS:\n"
         << "\t--help\tPrints this help message and quits\n"
         << "\t--only-parse\tOnly parse the json and quits (useful for "
            "benchmarking)\n"
         << "\t--debug\tPrint debug information\n"
+        << "\t--lines\tInput is newline delimited json (one document per "
+           "line), output one result per line\n"
+        << "\t--stream\tInput is a sequence of json documents (concatenated "
+           "or separated by whitespace), output one result per line\n"
+        << "\t--unordered\tWith --lines and --threads: don't keep the order "
+           "of the records in the output (faster)\n"
+        << "\t--threads N\tNumber of threads for everything that runs in "
+           "parallel: the root selectors and large arrays of a query, the "
+           "records of --lines and --stream, many files, --queries-from and "
+           "the clients of --serve (0 uses one thread per core, default is "
+           "1)\n"
+        << "\t--pin-threads\tPin the worker threads to separate cores\n"
+        << "\t--files-from FILE\tAlso query all files listed in FILE (one "
+           "per line, - for stdin)\n"
+        << "\t--with-filename\tWith many files: prefix every result with "
+           "the name of the file\n"
+        << "\t--queries-from FILE\tApply every selector in FILE (one per "
+           "line) to the json, output one result per line\n"
+        << "\t--output-dir DIR\tWith --queries-from: write the result of "
+           "the query on line N of FILE to DIR/N.json instead\n"
+        << "\t--serve SOCKET\tKeep the json in memory and answer selectors "
+           "sent to the UNIX socket SOCKET (use --threads to serve many "
+           "clients at once)\n"
+        << "\t--connect SOCKET\tSend the selectors to a --serve process "
+           "instead of reading json\n"
+        << "\t--clients N\tWith --connect: load test with N connections "
+           "in parallel\n"
+        << "\t--requests N\tWith --connect: load test with N requests in "
+           "total, prints the latencies\n"
+        << "\t--build-snapshot <json> <snapshot>\tParse the json file and "
+           "write it as a binary snapshot that can be queried later without "
+           "parsing\n"
+        << "\t--build-index <json>\tWrite the byte ranges of the values in "
+           "the json file to <json>.jqi, later queries on the file only "
+           "parse the part they select (until the file changes)\n"
+        << "\t--index-depth N\tWith --build-index: number of nesting "
+           "levels to index (default 1)\n"
+        << "\t--cache-dir DIR\tCache the results in DIR, running the same "
+           "selectors on the unchanged file again writes the cached result "
+           "without reading the file\n"
+        << "\t--cache-hash\tWith --cache-dir: also compare the content of "
+           "the file (reads the file, but doesn't parse it)\n"
+        << "\t--cache-limit MIB\tWith --cache-dir: size of the cache, the "
+           "least recently used results are removed (default 256)\n"
+        << "\t--stats\tPrint the time of every phase, the throughput, the "
+           "number of nodes, the number of allocations and the peak memory "
+           "usage\n"
+        << "\t--stats-json\tSame as --stats but as a json object on a "
+           "single line\n"
+        << "\t--trace FILE\tWrite the spans of all threads (reading, "
+           "parsing, evaluating, writing) to FILE in the Chrome trace event "
+           "format (open it with https://ui.perfetto.dev)\n"
+        << "\t--explain\tPrint the selectors as a plan tree (the json is "
+           "not read)\n"
+        << "\t--explain-analyze\tApply the selectors and print the plan "
+           "tree with the number of values every step visited and emitted, "
+           "the keys it missed and its time instead of the result\n"
         << "\n"
         << "All diagnostics and errors are written to stderr and the json "
            "output "
@@ -40,6 +181,42 @@ void print_help(const char* name) {
            "or command.\n";
 }
 
+/**
+ * Parses the value of an option as an unsigned number.
+ *
+ * Returns nothing if `argv[idx]` does not exist or is not a number.
+ */
+std::optional<unsigned> parse_unsigned(int argc, char** argv, int idx) {
+    if (idx >= argc) {
+        return std::nullopt;
+    }
+    const std::string value(argv[idx]);
+    if (value.empty() ||
+        value.find_first_not_of("0123456789") != std::string::npos) {
+        return std::nullopt;
+    }
+    try {
+        const unsigned long number = std::stoul(value);
+        // unsigned long can be larger, don't wrap around
+        if (number > std::numeric_limits<unsigned>::max()) {
+            return std::nullopt;
+        }
+        return static_cast<unsigned>(number);
+    } catch (const std::out_of_range&) {
+        return std::nullopt;
+    }
+}
+
+/**
+ * Returns the value of an option or nothing if `argv[idx]` does not exist.
+ */
+std::optional<std::string> parse_string(int argc, char** argv, int idx) {
+    if (idx >= argc) {
+        return std::nullopt;
+    }
+    return std::string(argv[idx]);
+}
+
 /**
  * Parse arguments from argc and argv from main.
  *
@@ -68,18 +245,133 @@ Arguments parse_arguments(int argc, char** argv) {
             args.only_parse = true;
         } else if (opt == "--debug") {
             args.debug = true;
+        } else if (opt == "--lines") {
+            args.lines = true;
+        } else if (opt == "--stream") {
+            args.stream = true;
+        } else if (opt == "--unordered") {
+            args.unordered = true;
+        } else if (opt == "--files-from") {
+            args.files_from = parse_string(argc, argv, ++idx);
+            if (!args.files_from) {
+                std::cerr << "--files-from requires a file\n\n";
+                error = true;
+            }
+        } else if (opt == "--queries-from") {
+            args.queries_from = parse_string(argc, argv, ++idx);
+            if (!args.queries_from) {
+                std::cerr << "--queries-from requires a file\n\n";
+                error = true;
+            }
+        } else if (opt == "--output-dir") {
+            args.output_dir = parse_string(argc, argv, ++idx);
+            if (!args.output_dir) {
+                std::cerr << "--output-dir requires a directory\n\n";
+                error = true;
+            }
+        } else if (opt == "--serve") {
+            args.serve = parse_string(argc, argv, ++idx);
+            if (!args.serve) {
+                std::cerr << "--serve requires a socket path\n\n";
+                error = true;
+            }
+        } else if (opt == "--connect") {
+            args.connect = parse_string(argc, argv, ++idx);
+            if (!args.connect) {
+                std::cerr << "--connect requires a socket path\n\n";
+                error = true;
+            }
+        } else if (opt == "--clients") {
+            auto clients = parse_unsigned(argc, argv, ++idx);
+            if (clients && clients.value() > 0) {
+                args.clients = clients.value();
+            } else {
+                std::cerr << "--clients requires a positive number\n\n";
+                error = true;
+            }
+        } else if (opt == "--requests") {
+            auto requests = parse_unsigned(argc, argv, ++idx);
+            if (requests && requests.value() > 0) {
+                args.requests = requests.value();
+            } else {
+                std::cerr << "--requests requires a positive number\n\n";
+                error = true;
+            }
+        } else if (opt == "--build-snapshot") {
+            args.build_snapshot = true;
+        } else if (opt == "--build-index") {
+            args.build_index = true;
+        } else if (opt == "--index-depth") {
+            auto depth = parse_unsigned(argc, argv, ++idx);
+            if (depth && depth.value() > 0) {
+                args.index_depth = depth.value();
+            } else {
+                std::cerr << "--index-depth requires a positive number\n\n";
+                error = true;
+            }
+        } else if (opt == "--cache-dir") {
+            args.cache_dir = parse_string(argc, argv, ++idx);
+            if (!args.cache_dir) {
+                std::cerr << "--cache-dir requires a directory\n\n";
+                error = true;
+            }
+        } else if (opt == "--cache-hash") {
+            args.cache_hash = true;
+        } else if (opt == "--cache-limit") {
+            auto limit = parse_unsigned(argc, argv, ++idx);
+            if (limit) {
+                args.cache_limit = limit.value();
+            } else {
+                std::cerr << "--cache-limit requires a number\n\n";
+                error = true;
+            }
+        } else if (opt == "--stats") {
+            args.stats = true;
+        } else if (opt == "--stats-json") {
+            args.stats = true;
+            args.stats_json = true;
+        } else if (opt == "--trace") {
+            args.trace = parse_string(argc, argv, ++idx);
+            if (!args.trace) {
+                std::cerr << "--trace requires a file\n\n";
+                error = true;
+            }
+        } else if (opt == "--explain") {
+            args.explain = true;
+        } else if (opt == "--explain-analyze") {
+            args.explain_analyze = true;
+        } else if (opt == "--with-filename") {
+            args.with_filename = true;
+        } else if (opt == "--pin-threads") {
+            args.pin_threads = true;
+        } else if (opt == "--threads") {
+            auto threads = parse_unsigned(argc, argv, ++idx);
+            if (threads) {
+                args.threads = threads.value();
+            } else {
+                std::cerr << "--threads requires a number\n\n";
+                error = true;
+            }
         } else {
             std::cerr << "Unrecognized option: \"" << opt << "\"\n\n";
             error = true;
         }
     }
 
+    if (args.lines && args.stream) {
+        std::cerr << "--lines and --stream can't be combined\n\n";
+        error = true;
+    }
+
     if (error) {
         print_help(argv[0]);
         throw CliException();
     }
 
-    if (argc >= idx + 1) {
+    if (args.queries_from || args.serve || args.build_snapshot ||
+        args.build_index) {
+        // the selectors come from the file or the clients (or aren't needed)
+    } else if (argc >= idx + 1) {
         args.selector = std::string(argv[idx]);
         idx++;
     } else {
@@ -88,9 +380,83 @@ Arguments parse_arguments(int argc, char** argv) {
         throw CliException();
     }
 
-    if (argc >= idx + 1) {
-        args.file = std::string(argv[idx]);
-        // idx++;
+    for (; idx < argc; ++idx) {
+        args.files.push_back(std::string(argv[idx]));
+    }
+
+    if ((args.lines || args.stream) && args.batch()) {
+        std::cerr << "--lines and --stream only support a single file\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.queries_from &&
+        (args.lines || args.stream || args.batch() || args.only_parse)) {
+        std::cerr << "--queries-from only supports a single json document\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.serve && (args.lines || args.stream || args.batch() ||
+                       args.queries_from || args.connect)) {
+        std::cerr << "--serve only supports a single json document\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.build_snapshot && args.files.size() != 2) {
+        std::cerr << "--build-snapshot requires <json> and <snapshot>\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.build_index && args.files.size() != 1) {
+        std::cerr << "--build-index requires <json>\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.cache_dir &&
+        (args.lines || args.stream || args.batch() || args.queries_from ||
+         args.serve || args.connect || args.build_snapshot ||
+         args.build_index || args.files.empty())) {
+        std::cerr << "--cache-dir only supports queries on a single json "
+                     "file\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.stats &&
+        (args.lines || args.stream || args.batch() || args.queries_from ||
+         args.serve || args.connect || args.build_snapshot ||
+         args.build_index || args.cache_dir)) {
+        std::cerr << "--stats only supports queries on a single json "
+                     "document\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.trace && (args.serve || args.connect)) {
+        std::cerr << "--trace can't be combined with --serve and "
+                     "--connect\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if ((args.explain || args.explain_analyze) &&
+        (args.lines || args.stream || args.batch() || args.queries_from ||
+         args.serve || args.connect || args.build_snapshot ||
+         args.build_index || args.cache_dir || args.stats)) {
+        std::cerr << "--explain and --explain-analyze only support a single "
+                     "json document\n\n";
+        print_help(argv[0]);
+        throw CliException();
+    }
+
+    if (args.connect && !args.files.empty()) {
+        std::cerr << "--connect doesn't read a json file\n\n";
+        print_help(argv[0]);
+        throw CliException();
     }
 
     return args;
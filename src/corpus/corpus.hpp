@@ -0,0 +1,378 @@
+#ifndef JSON_QUERY_CORPUS_CORPUS_HPP
+#define JSON_QUERY_CORPUS_CORPUS_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Synthetic json documents in the shapes the benchmarks need (see Shape).
+//
+// The output only depends on the shape, the size and the seed: the random
+// numbers come from our own generator (the distributions of <random> are
+// implementation defined) and no floating point formatting of the platform
+// is involved, so the same arguments give the same bytes everywhere.
+// Documents are written while they are generated, so their size is only
+// limited by the disk.
+namespace corpus {
+
+/**
+ * The shape (or size) is not known.
+ */
+class CorpusError : public std::exception {
+    std::string what_;
+
+public:
+    CorpusError(const std::string& message) : what_(message) {}
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+enum class Shape {
+    // array of records like test/generated.json
+    RECORDS,
+    // GeoJSON polygons: mostly numbers
+    GEO,
+    // array of trees nested up to 64 levels deep
+    DEEP,
+    // a single object with very many members
+    WIDE,
+    // array of strings full of escape sequences
+    ESCAPES,
+    // newline delimited log records (one document per line)
+    NDJSON
+};
+
+constexpr Shape SHAPES[] = {Shape::RECORDS, Shape::GEO,     Shape::DEEP,
+                            Shape::WIDE,    Shape::ESCAPES, Shape::NDJSON};
+
+const char* shape_name(Shape shape) {
+    switch (shape) {
+    case Shape::RECORDS:
+        return "records";
+    case Shape::GEO:
+        return "geo";
+    case Shape::DEEP:
+        return "deep";
+    case Shape::WIDE:
+        return "wide";
+    case Shape::ESCAPES:
+        return "escapes";
+    case Shape::NDJSON:
+        return "ndjson";
+    }
+    return "";
+}
+
+/**
+ * @throws CorpusError if there is no shape with that name
+ */
+Shape parse_shape(std::string_view name) {
+    for (Shape shape : SHAPES) {
+        if (name == shape_name(shape)) {
+            return shape;
+        }
+    }
+    throw CorpusError("unknown shape " + std::string(name));
+}
+
+/**
+ * Parses a size like `512`, `64K`, `10M` or `20G` (binary units).
+ *
+ * @throws CorpusError if it isn't one
+ */
+std::uint64_t parse_size(const std::string& size) {
+    std::size_t end = 0;
+    std::uint64_t value = 0;
+    try {
+        value = std::stoull(size, &end);
+    } catch (const std::exception&) {
+        throw CorpusError("invalid size " + size);
+    }
+    const std::string unit = size.substr(end);
+    if (unit.empty() || unit == "B") {
+        return value;
+    } else if (unit == "K" || unit == "KB") {
+        return value << 10;
+    } else if (unit == "M" || unit == "MB") {
+        return value << 20;
+    } else if (unit == "G" || unit == "GB") {
+        return value << 30;
+    }
+    throw CorpusError("invalid size " + size);
+}
+
+/**
+ * Small, fast and the same on every platform (splitmix64).
+ */
+class Rng {
+    std::uint64_t state;
+
+public:
+    explicit Rng(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * Uniform in [0, n) (the bias is irrelevant for test data).
+     */
+    std::uint64_t below(std::uint64_t n) { return next() % n; }
+
+    bool chance(unsigned percent) { return below(100) < percent; }
+
+    template <typename T, std::size_t N> const T& pick(const T (&items)[N]) {
+        return items[below(N)];
+    }
+};
+
+namespace detail {
+
+constexpr const char* FIRST_NAMES[] = {
+    "Maribel", "Jonas", "Amara", "Keith",  "Lucia", "Tobias",
+    "Noor",    "Emil",  "Sade",  "Walter", "Ines",  "Ravi"};
+constexpr const char* LAST_NAMES[] = {"King",  "Okafor", "Lindqvist",
+                                      "Moreau", "Tanaka", "Silva",
+                                      "Novak", "Reyes",  "Schmidt"};
+constexpr const char* WORDS[] = {
+    "lorem",  "ipsum",   "dolor",  "amet",   "tempor", "culpa",
+    "irure",  "laboris", "officia", "veniam", "nisi",   "commodo",
+    "quis",   "magna",   "aliqua", "esse",   "velit",  "fugiat"};
+constexpr const char* COLORS[] = {"green", "brown", "blue"};
+constexpr const char* LEVELS[] = {"debug", "info", "info",
+                                  "info",  "warn", "error"};
+constexpr const char* PATHS[] = {"/api/users", "/api/orders", "/health",
+                                 "/api/search", "/static/app.js"};
+// (no `\/`, the parser doesn't support it)
+constexpr const char* ESCAPES[] = {"\\n", "\\t", "\\\"", "\\\\", "\\r",
+                                   "\\b", "\\f", "\\u00e9", "\\u2603"};
+
+/**
+ * Counts what was written so the generators know when to stop.
+ */
+class Writer {
+    std::ostream& out;
+    std::uint64_t written = 0;
+
+public:
+    explicit Writer(std::ostream& out) : out(out) {}
+
+    Writer& operator<<(std::string_view s) {
+        out.write(s.data(), static_cast<std::streamsize>(s.size()));
+        written += s.size();
+        return *this;
+    }
+
+    Writer& operator<<(char c) {
+        out.put(c);
+        ++written;
+        return *this;
+    }
+
+    Writer& operator<<(std::uint64_t n) { return *this << std::to_string(n); }
+
+    std::uint64_t size() const { return written; }
+};
+
+/**
+ * A fixed point number with `decimals` decimals between -`max` (0 if not
+ * `negative`) and `max` (formatted without the platform's floating point
+ * formatting).
+ */
+void write_decimal(Writer& w, Rng& rng, std::uint64_t max, int decimals,
+                   bool negative = true) {
+    std::uint64_t scale = 1;
+    for (int i = 0; i < decimals; ++i) {
+        scale *= 10;
+    }
+    const std::uint64_t n = rng.below(max * scale);
+    if (negative && rng.chance(50)) {
+        w << '-';
+    }
+    std::string fraction = std::to_string(n % scale);
+    fraction.insert(0, decimals - fraction.size(), '0');
+    w << n / scale << '.' << fraction;
+}
+
+void write_words(Writer& w, Rng& rng, std::uint64_t count) {
+    for (std::uint64_t i = 0; i < count; ++i) {
+        w << (i == 0 ? "" : " ") << rng.pick(WORDS);
+    }
+}
+
+void write_hex(Writer& w, Rng& rng, int digits) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    for (int i = 0; i < digits; ++i) {
+        w << HEX[rng.below(16)];
+    }
+}
+
+void write_record(Writer& w, Rng& rng, std::uint64_t index) {
+    const char* first = rng.pick(FIRST_NAMES);
+    const char* last = rng.pick(LAST_NAMES);
+    w << "{\"_id\":\"";
+    write_hex(w, rng, 24);
+    w << "\",\"index\":" << index << ",\"guid\":\"";
+    write_hex(w, rng, 8);
+    w << '-';
+    for (int i = 0; i < 3; ++i) {
+        write_hex(w, rng, 4);
+        w << '-';
+    }
+    write_hex(w, rng, 12);
+    w << "\",\"isActive\":" << (rng.chance(50) ? "true" : "false")
+      << ",\"balance\":\"$" << 1 + rng.below(3) << ',' << 100 + rng.below(900)
+      << '.' << 10 + rng.below(90) << "\",\"age\":" << 18 + rng.below(60)
+      << ",\"eyeColor\":\"" << rng.pick(COLORS) << "\",\"name\":\"" << first
+      << ' ' << last << "\",\"email\":\"" << first << '.' << last
+      << "@example.com\",\"about\":\"";
+    write_words(w, rng, 10 + rng.below(30));
+    w << "\",\"latitude\":";
+    write_decimal(w, rng, 90, 6);
+    w << ",\"longitude\":";
+    write_decimal(w, rng, 180, 6);
+    w << ",\"tags\":[";
+    const std::uint64_t tags = 1 + rng.below(7);
+    for (std::uint64_t i = 0; i < tags; ++i) {
+        w << (i == 0 ? "\"" : ",\"") << rng.pick(WORDS) << '"';
+    }
+    w << "],\"friends\":[";
+    const std::uint64_t friends = 1 + rng.below(4);
+    for (std::uint64_t i = 0; i < friends; ++i) {
+        w << (i == 0 ? "" : ",") << "{\"id\":" << i << ",\"name\":\""
+          << rng.pick(FIRST_NAMES) << ' ' << rng.pick(LAST_NAMES) << "\"}";
+    }
+    w << "],\"favoriteFruit\":null}";
+}
+
+void write_feature(Writer& w, Rng& rng, std::uint64_t index) {
+    w << "{\"type\":\"Feature\",\"properties\":{\"id\":" << index
+      << ",\"name\":\"" << rng.pick(WORDS) << ' ' << index
+      << "\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[";
+    const std::uint64_t points = 4 + rng.below(60);
+    for (std::uint64_t i = 0; i < points; ++i) {
+        w << (i == 0 ? "[" : ",[");
+        write_decimal(w, rng, 180, 7);
+        w << ',';
+        write_decimal(w, rng, 90, 7);
+        w << ']';
+    }
+    w << "]]}}";
+}
+
+void write_tree(Writer& w, Rng& rng, unsigned depth) {
+    if (depth == 0) {
+        w << rng.below(1000);
+        return;
+    }
+    if (rng.chance(50)) {
+        w << "{\"level\":" << std::uint64_t{depth} << ",\"child\":";
+        write_tree(w, rng, depth - 1);
+        w << '}';
+    } else {
+        w << '[' << std::uint64_t{depth} << ',';
+        write_tree(w, rng, depth - 1);
+        w << ']';
+    }
+}
+
+void write_escaped_string(Writer& w, Rng& rng) {
+    w << '"' << rng.pick(WORDS);
+    const std::uint64_t parts = 1 + rng.below(20);
+    for (std::uint64_t i = 0; i < parts; ++i) {
+        w << rng.pick(ESCAPES) << rng.pick(WORDS);
+    }
+    w << '"';
+}
+
+void write_log(Writer& w, Rng& rng, std::uint64_t index) {
+    w << "{\"ts\":" << 1600000000000 + index * 7 + rng.below(7)
+      << ",\"level\":\"" << rng.pick(LEVELS) << "\",\"method\":\""
+      << (rng.chance(70) ? "GET" : "POST") << "\",\"path\":\""
+      << rng.pick(PATHS) << "\",\"status\":"
+      << (rng.chance(95) ? 200 : 500 + rng.below(4)) << ",\"latency_ms\":";
+    write_decimal(w, rng, 2000, 2, false);
+    w << ",\"request_id\":\"";
+    write_hex(w, rng, 16);
+    w << "\",\"msg\":\"";
+    write_words(w, rng, 3 + rng.below(8));
+    w << "\"}\n";
+}
+
+} // namespace detail
+
+/**
+ * Writes a document (or for NDJSON a sequence of them) of the given shape
+ * to `out` that is `bytes` long or slightly longer (it stops after the item
+ * that reaches the size). Returns the number of bytes written.
+ */
+std::uint64_t generate(std::ostream& out, Shape shape, std::uint64_t bytes,
+                       std::uint64_t seed) {
+    detail::Writer w(out);
+    Rng rng(seed);
+
+    // the items of the top level array (and where they start)
+    auto items = [&w, bytes](std::string_view begin, std::string_view end,
+                             auto&& item) {
+        w << begin;
+        for (std::uint64_t i = 0; i == 0 || w.size() + end.size() < bytes;
+             ++i) {
+            if (i != 0) {
+                w << ',';
+            }
+            item(i);
+        }
+        w << end;
+    };
+
+    switch (shape) {
+    case Shape::RECORDS:
+        items("[", "]", [&w, &rng](std::uint64_t i) {
+            detail::write_record(w, rng, i);
+        });
+        break;
+    case Shape::GEO:
+        items("{\"type\":\"FeatureCollection\",\"features\":[", "]}",
+              [&w, &rng](std::uint64_t i) {
+                  detail::write_feature(w, rng, i);
+              });
+        break;
+    case Shape::DEEP:
+        items("[", "]", [&w, &rng](std::uint64_t /*unused*/) {
+            detail::write_tree(w, rng, 1 + rng.below(64));
+        });
+        break;
+    case Shape::WIDE:
+        items("{", "}", [&w, &rng](std::uint64_t i) {
+            w << "\"member" << i << "\":";
+            if (rng.chance(50)) {
+                w << rng.below(1000000);
+            } else {
+                w << '"' << rng.pick(detail::WORDS) << '"';
+            }
+        });
+        break;
+    case Shape::ESCAPES:
+        items("[", "]", [&w, &rng](std::uint64_t /*unused*/) {
+            detail::write_escaped_string(w, rng);
+        });
+        break;
+    case Shape::NDJSON:
+        for (std::uint64_t i = 0; i == 0 || w.size() < bytes; ++i) {
+            detail::write_log(w, rng, i);
+        }
+        break;
+    }
+    return w.size();
+}
+
+} // namespace corpus
+
+#endif
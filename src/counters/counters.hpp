@@ -0,0 +1,200 @@
+#ifndef JSON_QUERY_COUNTERS_COUNTERS_HPP
+#define JSON_QUERY_COUNTERS_COUNTERS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Event counters on the hot paths (parser, selectors, serializer) for
+// diagnosing regressions without a profiler on the host.
+//
+// What is counted is decided at compile time by a policy: Disabled (the
+// default) makes every hook an empty inline function that the compiler
+// removes, PerThread counts. Build with `make COUNTERS=1` (which defines
+// JSON_QUERY_COUNTERS) to make PerThread the default policy.
+//
+// PerThread counts into plain thread local arrays (no atomics, no sharing)
+// that are merged into the totals when the thread exits. totals() adds the
+// arrays of the threads that are still running.
+//
+// NOTE: The hooks are called from the global `operator new`, so nothing here
+// may allocate.
+namespace counters {
+
+enum Counter : std::size_t {
+    OBJECTS_PARSED,
+    ARRAYS_PARSED,
+    STRINGS_PARSED,
+    NUMBERS_PARSED,
+    LITERALS_PARSED,
+    BYTES_SCANNED,
+    KEY_LOOKUPS,
+    KEY_MISSES,
+    EXCEPTIONS,
+    ALLOCATIONS,
+    VECTOR_REALLOCATIONS,
+    NODES_WRITTEN,
+    COUNTER_COUNT
+};
+
+constexpr const char* NAMES[COUNTER_COUNT] = {
+    "objects_parsed", "arrays_parsed",        "strings_parsed",
+    "numbers_parsed", "literals_parsed",      "bytes_scanned",
+    "key_lookups",    "key_misses",           "exceptions",
+    "allocations",    "vector_reallocations", "nodes_written"};
+
+using Values = std::array<std::uint64_t, COUNTER_COUNT>;
+
+/**
+ * Policy that counts nothing.
+ */
+struct Disabled {
+    static constexpr bool enabled = false;
+
+    static void add(Counter /*unused*/, std::uint64_t /*unused*/) {}
+};
+
+namespace detail {
+
+struct ThreadValues;
+
+struct Registry {
+    std::mutex mutex;
+    // threads that are still running (intrusive list, no allocation)
+    ThreadValues* threads = nullptr;
+    // merged from the threads that exited
+    std::array<std::atomic<std::uint64_t>, COUNTER_COUNT> exited{};
+};
+
+Registry& registry() {
+    // never destroyed, threads can exit after the static destructors ran
+    alignas(Registry) static unsigned char storage[sizeof(Registry)];
+    static Registry* registry = new (storage) Registry();
+    return *registry;
+}
+
+struct ThreadValues {
+    Values values{};
+    ThreadValues* next = nullptr;
+    ThreadValues* previous = nullptr;
+
+    ThreadValues() {
+        Registry& r = registry();
+        std::lock_guard lock(r.mutex);
+        next = r.threads;
+        if (next != nullptr) {
+            next->previous = this;
+        }
+        r.threads = this;
+    }
+
+    ~ThreadValues();
+
+    ThreadValues(const ThreadValues&) = delete;
+    ThreadValues& operator=(const ThreadValues&) = delete;
+};
+
+// values of this thread (nullptr before the first and after the last use)
+inline thread_local ThreadValues* current = nullptr;
+// set once the values of this thread were merged (counting after that goes
+// to the totals directly)
+inline thread_local bool merged = false;
+
+ThreadValues::~ThreadValues() {
+    Registry& r = registry();
+    std::lock_guard lock(r.mutex);
+    for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+        r.exited[i].fetch_add(values[i], std::memory_order_relaxed);
+    }
+    if (previous != nullptr) {
+        previous->next = next;
+    } else {
+        r.threads = next;
+    }
+    if (next != nullptr) {
+        next->previous = previous;
+    }
+    current = nullptr;
+    merged = true;
+}
+
+} // namespace detail
+
+/**
+ * Policy that counts per thread.
+ */
+struct PerThread {
+    static constexpr bool enabled = true;
+
+    static void add(Counter counter, std::uint64_t n) {
+        if (detail::current != nullptr) [[likely]] {
+            detail::current->values[counter] += n;
+        } else if (detail::merged) {
+            detail::registry().exited[counter].fetch_add(
+                n, std::memory_order_relaxed);
+        } else {
+            static thread_local detail::ThreadValues values;
+            detail::current = &values;
+            values.values[counter] += n;
+        }
+    }
+};
+
+#ifdef JSON_QUERY_COUNTERS
+using Default = PerThread;
+#else
+using Default = Disabled;
+#endif
+
+/**
+ * The hook: counts `n` events with the given policy.
+ */
+template <typename Policy = Default>
+inline void add(Counter counter, std::uint64_t n = 1) {
+    if constexpr (Policy::enabled) {
+        Policy::add(counter, n);
+    }
+}
+
+/**
+ * Appends to a vector and counts it if that reallocates the vector.
+ */
+template <typename Policy = Default, typename T, typename U>
+inline void push_back(std::vector<T>& vec, U&& value) {
+    if constexpr (Policy::enabled) {
+        if (vec.size() == vec.capacity()) {
+            Policy::add(VECTOR_REALLOCATIONS, 1);
+        }
+    }
+    vec.push_back(std::forward<U>(value));
+}
+
+/**
+ * Sum of the counters of all threads (PerThread policy). The counters of
+ * running threads are read while they may still change, so they are only
+ * exact if those threads are idle.
+ */
+Values totals() {
+    detail::Registry& r = detail::registry();
+    std::lock_guard lock(r.mutex);
+    Values values{};
+    for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+        values[i] = r.exited[i].load(std::memory_order_relaxed);
+    }
+    for (const detail::ThreadValues* t = r.threads; t != nullptr;
+         t = t->next) {
+        for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+            values[i] += t->values[i];
+        }
+    }
+    return values;
+}
+
+} // namespace counters
+
+#endif
@@ -15,6 +15,7 @@
 #include <memory>
 #include <stdexcept>
 
+#include "../counters/counters.hpp"
 #include "../errors.hpp"
 #include "types.hpp"
 
@@ -88,10 +89,20 @@ public:
     }
 };
 
+/**
+ * Lazy function for the semantic actions that counts a parsed node with the
+ * counters policy `Policy` (nothing with counters::Disabled).
+ */
+template <typename Policy> struct count_node_impl {
+    void operator()(counters::Counter counter) const {
+        counters::add<Policy>(counter);
+    }
+};
+
 // Grammar created using https://tools.ietf.org/html/rfc8259 and
 // https://www.json.org/
 // TODO support unicode
-template <typename Iterator>
+template <typename Iterator, typename Policy = counters::Default>
 struct json_grammar : qi::grammar<Iterator, JsonNode(), ascii::space_type> {
     json_grammar() : json_grammar::base_type(root) {
         using boost::phoenix::bind;
@@ -115,31 +126,38 @@ struct json_grammar : qi::grammar<Iterator, JsonNode(), ascii::space_type> {
         using qi::rule;
         using qi::uint_;
 
+        const boost::phoenix::function<count_node_impl<Policy>> count_node;
+
         root = value[_val = construct<JsonNode>(_1)];
         value = (literal | object | array | number |
                  string)[_val = construct<JsonNode>(_1)];
 
-        literal = lit("false")[_val = val(JsonLiteral(JSON_FALSE))] |
-                  lit("true")[_val = val(JsonLiteral(JSON_TRUE))] |
-                  lit("null")[_val = val(JsonLiteral(JSON_NULL))];
+        literal = (lit("false")[_val = val(JsonLiteral(JSON_FALSE))] |
+                   lit("true")[_val = val(JsonLiteral(JSON_TRUE))] |
+                   lit("null")[_val = val(JsonLiteral(JSON_NULL))])
+            [count_node(counters::LITERALS_PARSED)];
 
         object = ('{' > -(member % ',') >
-                  '}')[if_(_1)[_val = construct<JsonObject>(*_1)]
-                           .else_[_val = construct<JsonObject>()]];
+                  '}')[(if_(_1)[_val = construct<JsonObject>(*_1)]
+                            .else_[_val = construct<JsonObject>()],
+                        count_node(counters::OBJECTS_PARSED))];
         member =
             (string_inner > ':' >
              value)[_val = construct<std::pair<std::string, JsonNode>>(_1, _2)];
 
         array = ('[' > -(value % ',') >
-                 ']')[if_(_1)[_val = construct<JsonArray>(*_1)]
-                          .else_[_val = construct<JsonArray>()]];
+                 ']')[(if_(_1)[_val = construct<JsonArray>(*_1)]
+                           .else_[_val = construct<JsonArray>()],
+                       count_node(counters::ARRAYS_PARSED))];
 
         number = qi::as_string[lexeme[-char_('-') >> +digit >> -frac >> -exp]]
-                              [_val = construct<JsonNumber>(_1)];
+                              [(_val = construct<JsonNumber>(_1),
+                                count_node(counters::NUMBERS_PARSED))];
         frac = char_('.') >> +digit;
         exp = (char_('e') | char_('E')) >> -char_('-') >> +digit;
 
-        string = string_inner[_val = construct<JsonString>(_1)];
+        string = string_inner[(_val = construct<JsonString>(_1),
+                               count_node(counters::STRINGS_PARSED))];
 
         string_inner = '"' > lexeme[+(unescaped | escaped)[_val += _1]] > '"';
         unescaped = char_ - '"' - '\\' - ascii::cntrl;
@@ -181,22 +199,32 @@ struct json_grammar : qi::grammar<Iterator, JsonNode(), ascii::space_type> {
  * boost::spirit::line_pos_iterator<boost::spirit::istream_iterator> as the
  * Iterator type. It would just crash with an std::__ios_failure exception with
  * the message "basic_ios::clear: iostream error".
+ *
+ * The parsed nodes, the scanned bytes and the exceptions are counted with
+ * the counters policy `Policy`.
  */
+template <typename Policy = counters::Default>
 JsonNode parse_json(const std::string& s) {
     typedef boost::spirit::line_pos_iterator<std::string::const_iterator>
         Iterator;
     Iterator begin(s.cbegin());
     Iterator end(s.cend());
 
+    // building the grammar (all the rules) is expensive compared to parsing
+    // small documents so every thread builds it only once
+    static thread_local const json_grammar<Iterator, Policy> grammar;
+    counters::add<Policy>(counters::BYTES_SCANNED, s.size());
+
     JsonNode json;
     try {
-        bool ok = qi::phrase_parse(begin, end, json_grammar<Iterator>(),
-                                   ascii::space, json);
+        bool ok = qi::phrase_parse(begin, end, grammar, ascii::space, json);
 
         if (!ok || begin != end) {
+            counters::add<Policy>(counters::EXCEPTIONS);
             throw FailedToParseJsonException("parser failed");
         }
     } catch (InnerSyntaxError& e) {
+        counters::add<Policy>(counters::EXCEPTIONS);
         std::string expected;
         std::stringstream ss;
         ss << e.info;
@@ -5,11 +5,14 @@
 #include <boost/variant.hpp>
 #include <boost/variant/detail/apply_visitor_binary.hpp>
 #include <boost/variant/static_visitor.hpp>
+#include <cstddef>
 #include <iostream>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "../counters/counters.hpp"
 #include "../utils.hpp"
 
 namespace json {
@@ -17,6 +20,40 @@ namespace json {
 class JsonNode;
 std::ostream& operator<<(std::ostream& o, const JsonNode& self);
 
+/**
+ * Deep memory usage of a DOM (see JsonNode::memory_usage()) by what the
+ * bytes are used for. These are the bytes requested from the allocator, the
+ * allocator's own overhead per allocation is not included.
+ */
+struct MemoryUsage {
+    // the JsonNodes themselves (the variant, as large as the largest item)
+    std::size_t nodes = 0;
+    // heap buffers of strings and numbers (short ones are inside the node)
+    std::size_t strings = 0;
+    // keys of objects in the map (the std::string and its heap buffer)
+    std::size_t keys = 0;
+    // the per entry overhead of the map's tree nodes
+    std::size_t map_overhead = 0;
+    // the keys duplicated in JsonObject::keys() for the order
+    std::size_t order = 0;
+    // capacity of vectors that is allocated but not used
+    std::size_t vector_slack = 0;
+
+    std::size_t total() const {
+        return nodes + strings + keys + map_overhead + order + vector_slack;
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        nodes += other.nodes;
+        strings += other.strings;
+        keys += other.keys;
+        map_overhead += other.map_overhead;
+        order += other.order;
+        vector_slack += other.vector_slack;
+        return *this;
+    }
+};
+
 /**
  * A string in json.
  *
@@ -39,6 +76,16 @@ public:
 
     static const char* name() { return "String"; }
 
+    /**
+     * The content as it was in the json (escape sequences are not resolved).
+     */
+    const std::string& get() const { return str; }
+
+    /**
+     * Heap memory owned by the string (see JsonNode::memory_usage()).
+     */
+    MemoryUsage memory_usage() const;
+
     bool operator==(const JsonString&) const = default;
 
     friend std::ostream& operator<<(std::ostream& o, const JsonString& self);
@@ -68,6 +115,13 @@ public:
 
     static const char* name() { return "Number"; }
 
+    const std::string& get() const { return number; }
+
+    /**
+     * Heap memory owned by the number (see JsonNode::memory_usage()).
+     */
+    MemoryUsage memory_usage() const;
+
     bool operator==(const JsonNumber&) const = default;
 
     friend std::ostream& operator<<(std::ostream& o, const JsonNumber& self) {
@@ -110,11 +164,27 @@ public:
 
     static const char* name() { return "Object"; }
 
+    /**
+     * The keys in the order they appeared in the json.
+     */
+    const std::vector<std::string>& keys() const { return order; }
+
+    /**
+     * Returns a pointer to the value or `nullptr` if not found.
+     */
+    const JsonNode* find(const std::string& key) const;
+
     /**
      * Returns a reference to the value or throws std::out_of_range if not
      * found.
      */
-    const JsonNode& find(const std::string& key) const;
+    const JsonNode& at(const std::string& key) const;
+
+    /**
+     * Heap memory owned by the object, including all members (see
+     * JsonNode::memory_usage()).
+     */
+    MemoryUsage memory_usage() const;
 
     bool operator==(const JsonObject&) const;
 
@@ -146,6 +216,12 @@ public:
 
     const JsonNode& at(std::size_t index) const { return items.at(index); }
 
+    /**
+     * Heap memory owned by the array, including all items (see
+     * JsonNode::memory_usage()).
+     */
+    MemoryUsage memory_usage() const;
+
     bool operator==(const JsonArray&) const = default;
 
     friend std::ostream& operator<<(std::ostream&, const JsonArray&);
@@ -179,6 +255,13 @@ public:
 
     static const char* name() { return "Literal"; }
 
+    JsonLiteralValue get() const { return value; }
+
+    /**
+     * Literals own no heap memory.
+     */
+    MemoryUsage memory_usage() const { return {}; }
+
     bool operator==(const JsonLiteral&) const = default;
 
     friend std::ostream& operator<<(std::ostream& o, const JsonLiteral& self) {
@@ -235,25 +318,71 @@ public:
         return boost::get<J>(inner);
     }
 
+    /**
+     * Deep memory usage: this node and everything it owns on the heap. The
+     * items report only their heap memory, the node they are stored in is
+     * counted here.
+     */
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage = boost::apply_visitor(
+            [](is_json_item auto& x) { return x.memory_usage(); }, inner);
+        usage.nodes += sizeof(JsonNode);
+        return usage;
+    }
+
     /**
      * Allow visitation lambdas.
      */
     template <typename Visitor, typename... Args>
-    decltype(auto) apply_visitor(Visitor&& visitor, Args... args) const {
-        return boost::apply_visitor(visitor, inner, args...);
+    decltype(auto) apply_visitor(Visitor&& visitor, Args&&... args) const {
+        return boost::apply_visitor(visitor, inner,
+                                    std::forward<Args>(args)...);
     }
 
     friend std::ostream& operator<<(std::ostream& o, const JsonNode& self) {
+        counters::add(counters::NODES_WRITTEN);
         auto print = [&o](is_json_item auto& operand) { o << operand; };
         boost::apply_visitor(print, self.inner);
         return o;
     }
 };
 
+namespace detail {
+
+/**
+ * Size of the heap buffer of a string (0 if it is short enough to be stored
+ * inside the std::string).
+ */
+std::size_t string_heap_size(const std::string& s) {
+    const char* object = reinterpret_cast<const char*>(&s);
+    if (s.data() >= object && s.data() < object + sizeof(s)) {
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+// the tree node of a std::map entry: color, parent, left and right (in
+// libstdc++ and libc++) in front of the key and the value
+constexpr std::size_t MAP_NODE_HEADER = 4 * sizeof(void*);
+
+} // namespace detail
+
 // class JsonString
 std::ostream& operator<<(std::ostream& o, const JsonString& self) {
     return o << "\"" << self.str << "\"";
 }
+MemoryUsage JsonString::memory_usage() const {
+    MemoryUsage usage;
+    usage.strings = detail::string_heap_size(str);
+    return usage;
+}
+
+// class JsonNumber
+MemoryUsage JsonNumber::memory_usage() const {
+    MemoryUsage usage;
+    usage.strings = detail::string_heap_size(number);
+    return usage;
+}
 
 // class JsonObject
 JsonObject::JsonObject(
@@ -270,12 +399,33 @@ JsonObject::JsonObject(
 
         const std::string key_copy{key};
         this->members[key] = value;
-        this->order.push_back(key_copy);
+        counters::push_back(this->order, key_copy);
     }
 }
-const JsonNode& JsonObject::find(const std::string& key) const {
+const JsonNode* JsonObject::find(const std::string& key) const {
+    auto it = members.find(key);
+    if (it == members.end()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+const JsonNode& JsonObject::at(const std::string& key) const {
     return members.at(key);
 }
+MemoryUsage JsonObject::memory_usage() const {
+    MemoryUsage usage;
+    for (const auto& [key, value] : members) {
+        usage.map_overhead += detail::MAP_NODE_HEADER;
+        usage.keys += sizeof(std::string) + detail::string_heap_size(key);
+        usage += value.memory_usage();
+    }
+    for (const std::string& key : order) {
+        usage.order += sizeof(std::string) + detail::string_heap_size(key);
+    }
+    usage.vector_slack +=
+        (order.capacity() - order.size()) * sizeof(std::string);
+    return usage;
+}
 bool JsonObject::operator==(const JsonObject& other) const {
     return this->members == other.members;
 }
@@ -292,6 +442,14 @@ std::ostream& operator<<(std::ostream& o, const JsonObject& self) {
 }
 
 // class JsonArray
+MemoryUsage JsonArray::memory_usage() const {
+    MemoryUsage usage;
+    for (const JsonNode& item : items) {
+        usage += item.memory_usage();
+    }
+    usage.vector_slack += (items.capacity() - items.size()) * sizeof(JsonNode);
+    return usage;
+}
 std::ostream& operator<<(std::ostream& o, const JsonArray& self) {
     o << "[";
 
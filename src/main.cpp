@@ -1,17 +1,40 @@
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "cache/cache.hpp"
 #include "cli.hpp"
 #include "errors.hpp"
+#include "memory/allocations.hpp"
+#include "parallel/thread_pool.hpp"
+#include "selectors/queries.hpp"
 #include "selectors/selectors.hpp"
+#include "server/server.hpp"
+#include "server/watcher.hpp"
+#include "sidecar/index.hpp"
+#include "snapshot/snapshot.hpp"
+#include "stats/stats.hpp"
+#include "trace/trace.hpp"
+#include "stream/files.hpp"
+#include "stream/lines.hpp"
+#include "stream/values.hpp"
 #include "json/json.hpp"
 
 using json::JsonNode;
 using json::parse_json;
+using parallel::Affinity;
+using parallel::ThreadPool;
+using selectors::ApplyContext;
 using selectors::parse_selectors;
 using selectors::Selectors;
 
@@ -20,14 +43,50 @@ void print_arguments(const cli::Arguments& args) {
     std::cerr << "Arguments {" << std::endl
               << "\thelp = " << args.help << "," << std::endl
               << "\tonly_parse = " << args.only_parse << "," << std::endl
-              << "\tselector = \"" << args.selector << "\"," << std::endl
-              << "\tfile = ";
-    if (args.file) {
-        std::cerr << "\"" << args.file.value() << "\"";
+              << "\tlines = " << args.lines << "," << std::endl
+              << "\tstream = " << args.stream << "," << std::endl
+              << "\tunordered = " << args.unordered << "," << std::endl
+              << "\tthreads = " << args.threads << "," << std::endl
+              << "\tpin_threads = " << args.pin_threads << "," << std::endl
+              << "\tfiles_from = ";
+    if (args.files_from) {
+        std::cerr << "\"" << args.files_from.value() << "\"";
     } else {
         std::cerr << "none";
     }
-    std::cerr << "," << std::endl << "}" << std::endl;
+    std::cerr << "," << std::endl
+              << "\twith_filename = " << args.with_filename << "," << std::endl
+              << "\tqueries_from = "
+              << args.queries_from.value_or("none") << "," << std::endl
+              << "\toutput_dir = " << args.output_dir.value_or("none") << ","
+              << std::endl
+              << "\tserve = " << args.serve.value_or("none") << ","
+              << std::endl
+              << "\tconnect = " << args.connect.value_or("none") << ","
+              << std::endl
+              << "\tclients = " << args.clients << "," << std::endl
+              << "\trequests = " << args.requests << "," << std::endl
+              << "\tbuild_snapshot = " << args.build_snapshot << ","
+              << std::endl
+              << "\tbuild_index = " << args.build_index << "," << std::endl
+              << "\tindex_depth = " << args.index_depth << "," << std::endl
+              << "\tcache_dir = " << args.cache_dir.value_or("none") << ","
+              << std::endl
+              << "\tcache_hash = " << args.cache_hash << "," << std::endl
+              << "\tcache_limit = " << args.cache_limit << "," << std::endl
+              << "\tstats = " << args.stats << "," << std::endl
+              << "\tstats_json = " << args.stats_json << "," << std::endl
+              << "\ttrace = " << args.trace.value_or("none") << ","
+              << std::endl
+              << "\texplain = " << args.explain << "," << std::endl
+              << "\texplain_analyze = " << args.explain_analyze << ","
+              << std::endl
+              << "\tselector = \"" << args.selector << "\"," << std::endl
+              << "\tfiles = [";
+    for (const std::string& file : args.files) {
+        std::cerr << "\"" << file << "\", ";
+    }
+    std::cerr << "]," << std::endl << "}" << std::endl;
     std::cerr << "=== DEBUG END ===" << std::endl;
 }
 
@@ -55,6 +114,443 @@ std::string read_input(const std::optional<std::string>& file) {
     }
 }
 
+/**
+ * Reads the json from a file (text or snapshot) or stdin (only text).
+ *
+ * @throws InputFileException if the file can't be read
+ */
+JsonNode load_json(const std::optional<std::string>& file) {
+    if (file && snapshot::is_snapshot(file.value())) {
+        return snapshot::Snapshot(file.value()).root().decode();
+    }
+    return parse_json(read_input(file));
+}
+
+/**
+ * Creates the thread pool for the given number of threads (0 means one per
+ * core).
+ *
+ * The main thread also does work so it is not part of the pool. Returns
+ * `nullptr` if only one thread should be used.
+ */
+std::unique_ptr<ThreadPool> make_pool(unsigned threads, bool pin_threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads == 1) {
+        return nullptr;
+    }
+    return std::make_unique<ThreadPool>(
+        threads - 1, pin_threads ? Affinity::PIN_WORKERS : Affinity::NONE);
+}
+
+/**
+ * Opens the input file (or returns stdin) for streaming modes.
+ *
+ * @throws InputFileException if the file can't be opened
+ */
+std::istream& open_input(const std::optional<std::string>& file,
+                         std::ifstream& ifs) {
+    if (!file) {
+        return std::cin;
+    }
+    ifs.open(file.value());
+    if (!ifs.is_open()) {
+        throw errors::InputFileException();
+    }
+    return ifs;
+}
+
+/**
+ * Batch mode: applies the selectors to every file from the arguments and
+ * --files-from. Returns the exit code (1 if any file failed).
+ *
+ * @throws InputFileException if the --files-from file can't be read
+ */
+int process_files(const cli::Arguments& args) {
+    Selectors selectors = trace::traced("parse_selectors", [&args] {
+        return parse_selectors(args.selector.begin(), args.selector.end());
+    });
+
+    std::vector<std::string> files = args.files;
+    if (args.files_from) {
+        std::optional<std::string> list;
+        if (args.files_from.value() != "-") {
+            list = args.files_from;
+        }
+        std::ifstream ifs;
+        std::vector<std::string> listed =
+            stream::read_file_list(open_input(list, ifs));
+        files.insert(files.end(), listed.begin(), listed.end());
+    }
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    stream::FilesResult result = stream::process_files(
+        files, std::cout, std::cerr, selectors,
+        ApplyContext{.pool = pool.get()},
+        stream::FilesOptions{.with_filename = args.with_filename});
+
+    if (args.debug) {
+        std::cerr << "processed " << result.processed << " files, "
+                  << result.failed << " failed" << std::endl;
+    }
+    return result.failed == 0 ? 0 : 1;
+}
+
+/**
+ * Applies all queries from --queries-from to the json document. The results
+ * are written one per line (or to --output-dir). Returns the exit code (1 if
+ * any query failed).
+ *
+ * @throws InputFileException if the queries or the json can't be read
+ * @throws QueryError if one of the queries is not a valid selector
+ */
+int process_queries(const cli::Arguments& args) {
+    std::ifstream queries_file;
+    std::vector<selectors::Query> queries =
+        selectors::read_queries(open_input(args.queries_from, queries_file));
+    // before the document is parsed so typos are reported right away
+    std::vector<Selectors> compiled = trace::traced(
+        "parse_selectors",
+        [&queries] { return selectors::compile_queries(queries); });
+
+    const JsonNode json =
+        trace::traced("load_json", [&args] { return load_json(args.file()); });
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    std::vector<selectors::QueryResult> results =
+        trace::traced("apply", [&json, &compiled, &pool] {
+            return selectors::apply_queries(json, compiled,
+                                            ApplyContext{.pool = pool.get()});
+        });
+
+    trace::Span span("output");
+
+    if (args.output_dir) {
+        std::filesystem::create_directories(args.output_dir.value());
+    }
+    int exit_code = 0;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const std::size_t line = queries[i].line;
+        if (!results[i].error.empty()) {
+            std::cerr << "Failed to apply query on line " << line << ": "
+                      << results[i].error << "\n";
+            exit_code = 1;
+        } else if (args.output_dir) {
+            const std::filesystem::path path =
+                std::filesystem::path(args.output_dir.value()) /
+                (std::to_string(line) + ".json");
+            std::ofstream out(path);
+            out << results[i].output;
+            if (!out) {
+                std::cerr << "Failed to write " << path.string() << "\n";
+                exit_code = 1;
+            }
+        } else {
+            std::cout << results[i].output << '\n';
+        }
+    }
+    return exit_code;
+}
+
+/**
+ * Parses the json and answers queries on the --serve socket until the process
+ * is killed.
+ *
+ * If the json is read from a file, the file is watched and every new version
+ * is parsed in the background and then replaces the old one. Queries are
+ * never blocked by that. If the new version is not valid json the old one is
+ * kept.
+ *
+ * @throws ServerError if the socket can't be created
+ */
+int run_server(const cli::Arguments& args) {
+    server::Document document(load_json(args.file()));
+
+    std::unique_ptr<server::FileWatcher> watcher;
+    if (args.file()) {
+        const std::string file = args.file().value();
+        watcher = std::make_unique<server::FileWatcher>(file, [&document,
+                                                               file] {
+            try {
+                document.replace(load_json(file));
+                std::cerr << "Reloaded " << file << " (version "
+                          << document.get_version() << ")" << std::endl;
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to reload " << file << ": " << e.what()
+                          << std::endl;
+            }
+        });
+    }
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    server::Server server(document, args.serve.value(),
+                          ApplyContext{.pool = pool.get()});
+    std::cerr << "Listening on " << args.serve.value() << std::endl;
+    server.serve();
+    return 0;
+}
+
+/**
+ * Sends the selectors to a --serve process and prints the result. With
+ * --clients or --requests a load test is run instead and the latencies are
+ * printed.
+ *
+ * @throws ServerError if the server can't be reached
+ */
+int run_client(const cli::Arguments& args) {
+    if (args.clients == 1 && args.requests == 1) {
+        server::Client client(args.connect.value());
+        auto [status, response] = client.query(args.selector);
+        if (status != server::Status::OK) {
+            std::cerr << "\033[31mError:\033[0m " << response << "\n";
+            return 1;
+        }
+        std::cout << response;
+        return 0;
+    }
+
+    server::LoadStats stats = server::run_load(
+        args.connect.value(), args.selector, args.clients, args.requests);
+    auto micros = [](std::chrono::nanoseconds duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+    std::cout << "requests: " << stats.requests << "\n"
+              << "clients: " << args.clients << "\n"
+              << "errors: " << stats.errors << "\n"
+              << "throughput: " << stats.requests / stats.seconds
+              << " requests/s\n"
+              << "p50: " << micros(stats.p50) << " us\n"
+              << "p99: " << micros(stats.p99) << " us\n"
+              << "max: " << micros(stats.max) << " us\n";
+    return stats.errors == 0 ? 0 : 1;
+}
+
+/**
+ * Parses the json file and writes it as a snapshot.
+ *
+ * @throws SnapshotError if the snapshot can't be written
+ */
+int build_snapshot(const cli::Arguments& args) {
+    const JsonNode json = parse_json(read_input(args.files[0]));
+    std::ofstream out(args.files[1], std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw snapshot::SnapshotError("can't create " + args.files[1]);
+    }
+    snapshot::write_snapshot(json, out);
+    if (args.debug) {
+        std::cerr << "snapshot size: " << out.tellp() << " bytes" << std::endl;
+    }
+    return 0;
+}
+
+/**
+ * Writes the result to stdout (counting the bytes with --stats).
+ */
+void write_output(const JsonNode& output, const cli::Arguments& args,
+                  stats::Report& report) {
+    report.time("output", [&] {
+        if (!args.stats) {
+            std::cout << output << std::flush;
+            return;
+        }
+        stats::CountingBuffer counter(std::cout.rdbuf());
+        std::ostream out(&counter);
+        out << output << std::flush;
+        report.output_bytes = counter.get_count();
+    });
+    if (args.stats) {
+        report.output_nodes = stats::count_nodes(output);
+    }
+}
+
+void print_stats(const cli::Arguments& args, stats::Report& report) {
+    report.allocations = memory::allocation_count();
+    if constexpr (counters::Default::enabled) {
+        report.events = counters::totals();
+    }
+    report.peak_rss = stats::peak_rss();
+    if (args.stats_json) {
+        report.print_json(std::cerr);
+    } else {
+        report.print(std::cerr);
+    }
+}
+
+/**
+ * Answers the selectors directly from a snapshot file (see snapshot::apply).
+ */
+int query_snapshot(const cli::Arguments& args, stats::Report& report) {
+    const std::string file = args.file().value();
+    const snapshot::Snapshot snapshot =
+        report.time("map", [&file] { return snapshot::Snapshot(file); });
+    report.input_bytes = std::filesystem::file_size(file);
+    Selectors selectors = report.time("parse_selectors", [&args] {
+        return parse_selectors(args.selector.begin(), args.selector.end());
+    });
+    if (args.only_parse) {
+        std::cerr << "Quitting after parse because of --only-parse flag.\n";
+        return 0;
+    }
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    const JsonNode output = report.time("apply", [&] {
+        return snapshot::apply(selectors, snapshot,
+                               ApplyContext{.pool = pool.get()});
+    });
+    write_output(output, args, report);
+    return 0;
+}
+
+/**
+ * Answers the selectors with the help of the sidecar index of the file (see
+ * sidecar::apply). Returns nothing (and writes nothing) if the index turns
+ * out to be damaged.
+ */
+std::optional<int> query_index(const cli::Arguments& args,
+                               const sidecar::Index& index,
+                               stats::Report& report) {
+    report.input_bytes = index.file_size();
+    Selectors selectors = report.time("parse_selectors", [&args] {
+        return parse_selectors(args.selector.begin(), args.selector.end());
+    });
+    if (args.debug) {
+        std::cerr << "using index " << sidecar::index_path(*args.file())
+                  << std::endl;
+    }
+    if (args.only_parse) {
+        std::cerr << "Quitting after parse because of --only-parse flag.\n";
+        return 0;
+    }
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    const std::optional<JsonNode> output = report.time("apply", [&] {
+        return sidecar::apply(selectors, index,
+                              ApplyContext{.pool = pool.get()});
+    });
+    if (!output) {
+        return std::nullopt;
+    }
+    write_output(*output, args, report);
+    return 0;
+}
+
+/**
+ * Applies the selectors to a file in the fastest way available (snapshot,
+ * sidecar index or parsing).
+ */
+JsonNode apply_to_file(const std::string& file, const Selectors& selectors,
+                       const ApplyContext& ctx) {
+    if (snapshot::is_snapshot(file)) {
+        return snapshot::apply(selectors, snapshot::Snapshot(file), ctx);
+    }
+    if (std::optional<sidecar::Index> index = sidecar::Index::open(file)) {
+        if (std::optional<JsonNode> result =
+                sidecar::apply(selectors, *index, ctx)) {
+            return std::move(*result);
+        }
+    }
+    return selectors.apply(parse_json(read_input(file)), ctx);
+}
+
+/**
+ * Writes the cached result if the same selectors were already applied to
+ * the unchanged file, otherwise queries the file and caches the result.
+ */
+int query_cached(const cli::Arguments& args) {
+    const std::string file = args.file().value();
+    Selectors selectors =
+        parse_selectors(args.selector.begin(), args.selector.end());
+    cache::ResultCache cache(args.cache_dir.value(), args.cache_limit << 20);
+    const std::string key = cache::make_key(file, selectors, args.cache_hash);
+    if (cache.load(key, std::cout)) {
+        if (args.debug) {
+            std::cerr << "cache hit" << std::endl;
+        }
+        return 0;
+    }
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    std::ostringstream output;
+    output << apply_to_file(file, selectors, ApplyContext{.pool = pool.get()});
+    // the result is only valid if the file didn't change while it was read
+    if (cache::make_key(file, selectors, args.cache_hash) == key) {
+        cache.store(key, output.view());
+    }
+    std::cout << output.view();
+    return 0;
+}
+
+/**
+ * Applies the selectors to the json with a profile and prints the plan tree
+ * with the counters instead of the result. If the selectors fail the plan is
+ * printed up to the failure and the error is thrown afterwards.
+ */
+int explain_analyze(const cli::Arguments& args) {
+    Selectors selectors =
+        parse_selectors(args.selector.begin(), args.selector.end());
+    const JsonNode json = load_json(args.file());
+
+    std::unique_ptr<ThreadPool> pool =
+        make_pool(args.threads, args.pin_threads);
+    std::unique_ptr<selectors::Profile> profile =
+        selectors::make_profile(selectors);
+    const auto start = std::chrono::steady_clock::now();
+    std::exception_ptr error;
+    try {
+        selectors.apply(json, ApplyContext{.pool = pool.get(),
+                                           .profile = profile.get()});
+    } catch (const selectors::ApplySelectorError&) {
+        error = std::current_exception();
+    }
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    selectors::explain(std::cout, selectors, profile.get());
+    std::cout << "Execution time: " << elapsed.count() << " ms\n";
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return 0;
+}
+
+/**
+ * Records a trace while it exists and writes it to the file when it is
+ * destroyed (also when the run failed). Has to be destroyed after all
+ * threads are done.
+ */
+class TraceFile {
+    std::string path;
+
+public:
+    explicit TraceFile(const std::string& path) : path(path) {
+        trace::enable();
+        trace::name_thread("main");
+    }
+
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    ~TraceFile() {
+        std::ofstream out(path, std::ios::trunc);
+        trace::write(out);
+        if (!out) {
+            std::cerr << "Failed to write trace to " << path << std::endl;
+        }
+        if (const std::size_t dropped = trace::dropped_events()) {
+            std::cerr << "The trace is missing " << dropped
+                      << " events, the buffers of the threads were full"
+                      << std::endl;
+        }
+    }
+};
+
 int main(int argc, char* argv[]) {
     cli::Arguments args;
     std::string content;
@@ -70,25 +566,146 @@ int main(int argc, char* argv[]) {
             print_arguments(args);
         }
 
-        content = read_input(args.file);
+        std::optional<TraceFile> trace_file;
+        if (args.trace) {
+            trace_file.emplace(args.trace.value());
+        }
+
+        if (args.explain) {
+            selectors::explain(std::cout, parse_selectors(args.selector));
+            return 0;
+        }
+
+        if (args.explain_analyze) {
+            return explain_analyze(args);
+        }
+
+        if (args.batch()) {
+            return process_files(args);
+        }
+
+        if (args.queries_from) {
+            return process_queries(args);
+        }
+
+        if (args.build_snapshot) {
+            return build_snapshot(args);
+        }
+
+        if (args.build_index) {
+            sidecar::build_index(args.files[0], args.index_depth);
+            return 0;
+        }
+
+        if (args.serve) {
+            return run_server(args);
+        }
+
+        if (args.connect) {
+            return run_client(args);
+        }
+
+        if (args.lines || args.stream) {
+            Selectors selectors =
+                parse_selectors(args.selector.begin(), args.selector.end());
+            std::unique_ptr<ThreadPool> pool =
+                make_pool(args.threads, args.pin_threads);
+
+            std::ifstream ifs;
+            std::istream& in = open_input(args.file(), ifs);
+            const ApplyContext ctx{.pool = pool.get()};
+            trace::Span span(args.lines ? "process_lines" : "process_values");
+            if (args.lines) {
+                stream::process_lines_parallel(
+                    in, std::cout, selectors, ctx,
+                    stream::ParallelLinesOptions{.ordered = !args.unordered});
+            } else {
+                stream::process_values(in, std::cout, selectors, ctx);
+            }
+            return 0;
+        }
 
-        JsonNode json = parse_json(content);
+        if (args.cache_dir && !args.only_parse) {
+            return query_cached(args);
+        }
 
-        Selectors selectors =
-            parse_selectors(args.selector.begin(), args.selector.end());
+        stats::Report report;
+        if (args.stats) {
+            memory::count_allocations();
+        }
+
+        if (args.file() && snapshot::is_snapshot(args.file().value())) {
+            const int status = query_snapshot(args, report);
+            if (args.stats) {
+                print_stats(args, report);
+            }
+            return status;
+        }
+
+        if (args.file()) {
+            std::optional<sidecar::Index> index =
+                sidecar::Index::open(args.file().value());
+            if (!index && args.debug &&
+                std::filesystem::exists(sidecar::index_path(*args.file()))) {
+                std::cerr << "not using stale or damaged index "
+                          << sidecar::index_path(*args.file()) << std::endl;
+            }
+            if (index) {
+                if (const std::optional<int> status =
+                        query_index(args, *index, report)) {
+                    if (args.stats) {
+                        print_stats(args, report);
+                    }
+                    return *status;
+                }
+                if (args.debug) {
+                    std::cerr << "not using damaged index "
+                              << sidecar::index_path(*args.file())
+                              << std::endl;
+                }
+                // start over without the index
+                report = stats::Report();
+            }
+        }
+
+        content =
+            report.time("read", [&args] { return read_input(args.file()); });
+        report.input_bytes = content.size();
+
+        JsonNode json = report.time("parse_json",
+                                    [&content] { return parse_json(content); });
+
+        Selectors selectors = report.time("parse_selectors", [&args] {
+            return parse_selectors(args.selector.begin(), args.selector.end());
+        });
 
         if (args.debug) {
             std::cerr << "json content:\n" << json << "\n";
             std::cerr << "selectors:\n" << selectors << "\n";
         }
 
+        if (args.stats) {
+            report.input_nodes = stats::count_nodes(json);
+        }
+
         if (args.only_parse) {
             std::cerr << "Quitting after parse because of --only-parse flag.\n";
+            if (args.stats) {
+                print_stats(args, report);
+            }
             return 0;
         }
-        JsonNode output = selectors.apply(json);
 
-        std::cout << output;
+        std::unique_ptr<ThreadPool> pool =
+            make_pool(args.threads, args.pin_threads);
+
+        JsonNode output = report.time(
+            "apply", [&] { return selectors.apply(json, pool.get()); });
+
+        write_output(output, args, report);
+        if (args.stats) {
+            print_stats(args, report);
+        }
     } catch (const errors::InputFileException& e) {
         std::cerr << e.what() << std::endl;
         return 1;
@@ -106,6 +723,27 @@ int main(int argc, char* argv[]) {
         return 1;
     } catch (const cli::CliException&) {
         return 1;
+    } catch (const std::filesystem::filesystem_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const snapshot::SnapshotError& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const cache::CacheError& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const sidecar::IndexError& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const server::ServerError& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const selectors::QueryError& e) {
+        std::cerr << "Failed to parse " << e.what() << "\n";
+        return 1;
+    } catch (const stream::RecordError& e) {
+        std::cerr << "Failed to process " << e.what() << "\n";
+        return 1;
     } catch (const selectors::ApplySelectorError& e) {
         std::cerr << "Failed to apply selector. "
             << "Maybe selectors and json structure don't match?\n\n"
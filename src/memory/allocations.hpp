@@ -0,0 +1,94 @@
+#ifndef JSON_QUERY_MEMORY_ALLOCATIONS_HPP
+#define JSON_QUERY_MEMORY_ALLOCATIONS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "../counters/counters.hpp"
+
+// Counts the allocations of the whole program (for --stats and the event
+// counters) by replacing the global `operator new`/`operator delete`. The
+// memory itself comes from malloc (or aligned_alloc for over-aligned types)
+// as usual.
+//
+// NOTE: This header replaces the global `operator new`/`operator delete` so
+// it must only be included in one translation unit per program (like all
+// other headers here).
+namespace memory {
+
+namespace detail {
+
+// allocations are only counted on request, otherwise all threads would write
+// to the same counter on every `new`
+inline std::atomic<bool> counting{false};
+inline std::atomic<std::size_t> allocations{0};
+
+void count() {
+    counters::add(counters::ALLOCATIONS);
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace detail
+
+/**
+ * Starts counting the calls of `operator new` (on all threads).
+ */
+void count_allocations() {
+    detail::counting.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Number of allocations since count_allocations() was called.
+ */
+std::size_t allocation_count() {
+    return detail::allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace memory
+
+// The replaceable global allocation functions. The array, nothrow and sized
+// versions of the standard library forward to these.
+
+void* operator new(std::size_t size) {
+    memory::detail::count();
+    if (void* p = std::malloc(std::max(size, std::size_t{1}))) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    memory::detail::count();
+    const auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size = (std::max(size, std::size_t{1}) + align - 1) & ~(align - 1);
+    if (void* p = std::aligned_alloc(align, size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// not inlined so the compiler doesn't take the `free` for a mismatch with the
+// `new` at the call site
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t /*unused*/) noexcept {
+    operator delete(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p,
+                                       std::align_val_t /*unused*/) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t /*unused*/,
+                     std::align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+
+#endif
@@ -0,0 +1,415 @@
+#ifndef JSON_QUERY_PARALLEL_THREAD_POOL_HPP
+#define JSON_QUERY_PARALLEL_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Shared runtime for everything that runs in parallel (selectors, parser,
+// output, ...). The pool itself only knows about opaque tasks, the helpers
+// below it (parallel_for, parallel_reduce, ...) implement fork/join on top of
+// it.
+namespace parallel {
+
+/**
+ * Whether the worker threads of a ThreadPool are pinned to cores.
+ */
+enum class Affinity {
+    /**
+     * Let the OS schedule the workers.
+     */
+    NONE,
+    /**
+     * Pin worker `i` to core `i + 1` (wrapping around) so the calling thread
+     * keeps core 0 for itself. Only supported on linux, ignored elsewhere.
+     */
+    PIN_WORKERS
+};
+
+/**
+ * Fixed size pool of worker threads with work stealing.
+ *
+ * Every worker has its own deque of tasks. Tasks submitted by a worker are
+ * pushed to the back of its own deque and it pops them from the back again
+ * (so nested work stays hot in the cache). Idle workers steal from the front
+ * of the other deques. Tasks submitted from threads outside the pool go to a
+ * shared queue that all workers take from.
+ *
+ * When the pool is destroyed the tasks still queued are run and then the
+ * workers are joined.
+ */
+class ThreadPool {
+    using Task = std::function<void()>;
+
+    struct WorkerQueue {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    // tasks submitted from threads that are not workers of this pool
+    std::deque<Task> injected;
+    // protects `injected` and `stopping` and is used to wait for work
+    std::mutex mutex;
+    std::condition_variable available;
+    // number of tasks in all queues together
+    std::atomic<std::size_t> pending{0};
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    // pool and queue index of the worker running on the current thread
+    static inline thread_local ThreadPool* current_pool = nullptr;
+    static inline thread_local std::size_t current_index = 0;
+
+public:
+    explicit ThreadPool(std::size_t num_workers,
+                        Affinity affinity = Affinity::NONE) {
+        queues.reserve(num_workers);
+        for (std::size_t i = 0; i < num_workers; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        workers.reserve(num_workers);
+        for (std::size_t i = 0; i < num_workers; ++i) {
+            workers.emplace_back([this, i] { run(i); });
+            if (affinity == Affinity::PIN_WORKERS) {
+                pin(workers.back(), i + 1);
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /**
+     * Number of worker threads. Threads that only submit work (e.g. the main
+     * thread) are not counted.
+     */
+    std::size_t size() const { return workers.size(); }
+
+    void submit(Task task) {
+        // counted before the task can be taken (and `pending` decremented)
+        // by another thread, so `pending` never wraps around
+        pending.fetch_add(1);
+        if (current_pool == this) {
+            WorkerQueue& own = *queues[current_index];
+            std::lock_guard lock(own.mutex);
+            own.tasks.push_back(std::move(task));
+        } else {
+            std::lock_guard lock(mutex);
+            injected.push_back(std::move(task));
+        }
+        {
+            // so a worker can't miss the notification between checking
+            // `pending` and starting to wait
+            std::lock_guard lock(mutex);
+        }
+        available.notify_one();
+    }
+
+    /**
+     * Runs one queued task on the calling thread if there is one.
+     *
+     * Used by threads that wait for other tasks to finish so they do useful
+     * work instead of blocking. Returns false if there was nothing to run.
+     */
+    bool run_one() {
+        Task task;
+        if (!try_pop(task)) {
+            return false;
+        }
+        pending.fetch_sub(1);
+        task();
+        return true;
+    }
+
+private:
+    static void pin([[maybe_unused]] std::thread& thread,
+                    [[maybe_unused]] std::size_t core) {
+#ifdef __linux__
+        const unsigned cores =
+            std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core % cores, &set);
+        // best effort: if the core is not available to us the OS keeps
+        // scheduling the thread where it wants
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+    }
+
+    bool try_pop(Task& task) {
+        const bool is_worker = current_pool == this;
+        if (is_worker) {
+            WorkerQueue& own = *queues[current_index];
+            std::lock_guard lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        {
+            std::lock_guard lock(mutex);
+            if (!injected.empty()) {
+                task = std::move(injected.front());
+                injected.pop_front();
+                return true;
+            }
+        }
+        const std::size_t start = is_worker ? current_index + 1 : 0;
+        for (std::size_t i = 0; i < queues.size(); ++i) {
+            WorkerQueue& victim = *queues[(start + i) % queues.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(std::size_t index) {
+        current_pool = this;
+        current_index = index;
+        while (true) {
+            if (run_one()) {
+                continue;
+            }
+            std::unique_lock lock(mutex);
+            available.wait(lock, [this] { return stopping || pending > 0; });
+            if (stopping && pending == 0) {
+                return;
+            }
+        }
+    }
+};
+
+/**
+ * Calls `body(i)` for every `i` in `[0, n)` on the pool and the calling
+ * thread and returns once all calls are finished (fork/join).
+ *
+ * Indices are handed out one at a time from a shared counter. The calling
+ * thread takes part in that, so it always makes progress on its own even if
+ * all workers are busy (e.g. when called from inside another parallel_for).
+ * While it waits for the last indices to finish it runs other queued tasks.
+ *
+ * If `pool` is `nullptr` everything runs serially on the calling thread.
+ *
+ * If calls throw, the exception of the lowest index is rethrown. This way the
+ * error is the same as the one serial execution would have reported.
+ */
+template <typename Body>
+void parallel_for(ThreadPool* pool, std::size_t n, const Body& body) {
+    if (pool == nullptr || pool->size() == 0 || n < 2) {
+        for (std::size_t i = 0; i < n; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    // shared with the helper tasks because they might only start running
+    // after this function returned (they then see that there is no work left
+    // and never touch `body`)
+    struct State {
+        std::function<void(std::size_t)> body;
+        std::size_t n;
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::size_t error_index;
+        std::exception_ptr error;
+
+        void work() {
+            std::size_t i;
+            while ((i = next.fetch_add(1)) < n) {
+                try {
+                    body(i);
+                } catch (...) {
+                    std::lock_guard lock(mutex);
+                    if (!error || i < error_index) {
+                        error_index = i;
+                        error = std::current_exception();
+                    }
+                }
+                if (done.fetch_add(1) + 1 == n) {
+                    std::lock_guard lock(mutex);
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+
+    auto state = std::make_shared<State>();
+    state->body = [&body](std::size_t i) { body(i); };
+    state->n = n;
+
+    const std::size_t helpers = std::min(pool->size(), n - 1);
+    for (std::size_t i = 0; i < helpers; ++i) {
+        pool->submit([state] { state->work(); });
+    }
+
+    state->work();
+
+    while (state->done != state->n && pool->run_one()) {
+    }
+
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock, [&state] { return state->done == state->n; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+/**
+ * Runs `first` and `second` in parallel and returns once both are finished.
+ */
+template <typename First, typename Second>
+void parallel_invoke(ThreadPool* pool, const First& first,
+                     const Second& second) {
+    parallel_for(pool, 2, [&first, &second](std::size_t i) {
+        if (i == 0) {
+            first();
+        } else {
+            second();
+        }
+    });
+}
+
+/**
+ * Number of chunks parallel_for_chunks splits `n` indices into.
+ */
+std::size_t num_chunks(const ThreadPool* pool, std::size_t n,
+                       std::size_t grain) {
+    grain = std::max(grain, std::size_t{1});
+    if (pool == nullptr || pool->size() == 0 || n < 2 * grain) {
+        return n == 0 ? 0 : 1;
+    }
+    // a few chunks per thread so threads that finish early can take over
+    // work from the ones that got expensive items
+    const std::size_t max_chunks = 4 * (pool->size() + 1);
+    return std::min(n / grain, max_chunks);
+}
+
+/**
+ * Splits `[0, n)` into num_chunks() consecutive chunks and calls
+ * `body(chunk, begin, end)` for each of them in parallel.
+ *
+ * Chunks contain at least `grain` indices so if `n` is smaller than that (or
+ * `pool` is `nullptr`) `body` is called once on the calling thread and no
+ * threads are involved at all.
+ */
+template <typename Body>
+void parallel_for_chunks(ThreadPool* pool, std::size_t n, std::size_t grain,
+                         const Body& body) {
+    const std::size_t chunks = num_chunks(pool, n, grain);
+    if (chunks <= 1) {
+        if (chunks == 1) {
+            body(std::size_t{0}, std::size_t{0}, n);
+        }
+        return;
+    }
+
+    const std::size_t chunk_size = (n + chunks - 1) / chunks;
+    parallel_for(pool, chunks, [&](std::size_t chunk) {
+        const std::size_t begin = chunk * chunk_size;
+        const std::size_t end = std::min(n, begin + chunk_size);
+        if (begin < end) {
+            body(chunk, begin, end);
+        }
+    });
+}
+
+/**
+ * Calls `body(begin, end, out)` for consecutive chunks of `[0, n)` in
+ * parallel and concatenates the vectors the chunks appended to in the order
+ * of the chunks.
+ *
+ * See parallel_for_chunks for how the chunks are chosen.
+ */
+template <typename T, typename Body>
+std::vector<T> parallel_concat(ThreadPool* pool, std::size_t n,
+                               std::size_t grain, const Body& body) {
+    std::vector<T> result;
+    const std::size_t chunks = num_chunks(pool, n, grain);
+    if (chunks <= 1) {
+        body(std::size_t{0}, n, result);
+        return result;
+    }
+
+    std::vector<std::vector<T>> parts{chunks};
+    parallel_for_chunks(
+        pool, n, grain,
+        [&body, &parts](std::size_t chunk, std::size_t begin,
+                        std::size_t end) { body(begin, end, parts[chunk]); });
+
+    std::size_t total = 0;
+    for (const std::vector<T>& part : parts) {
+        total += part.size();
+    }
+    result.reserve(total);
+    for (std::vector<T>& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(result));
+    }
+    return result;
+}
+
+/**
+ * Reduces `[0, n)` in parallel.
+ *
+ * `map(begin, end)` computes the result of one chunk, the chunk results are
+ * then folded with `combine` from left to right starting with `identity`. So
+ * `combine` only needs to be associative, not commutative, and the result is
+ * the same for any number of threads.
+ *
+ * See parallel_for_chunks for how the chunks are chosen.
+ */
+template <typename T, typename Map, typename Combine>
+T parallel_reduce(ThreadPool* pool, std::size_t n, std::size_t grain,
+                  T identity, const Map& map, const Combine& combine) {
+    std::vector<std::optional<T>> partial(num_chunks(pool, n, grain));
+    parallel_for_chunks(pool, n, grain,
+                        [&map, &partial](std::size_t chunk, std::size_t begin,
+                                         std::size_t end) {
+                            partial[chunk].emplace(map(begin, end));
+                        });
+
+    T result = std::move(identity);
+    for (std::optional<T>& value : partial) {
+        if (value) {
+            result = combine(std::move(result), std::move(*value));
+        }
+    }
+    return result;
+}
+
+} // namespace parallel
+
+#endif
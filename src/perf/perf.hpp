@@ -0,0 +1,271 @@
+#ifndef JSON_QUERY_PERF_PERF_HPP
+#define JSON_QUERY_PERF_PERF_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware performance counters of the current thread (perf_event_open) for
+// the benchmarks: cycles, instructions, branch misses and cache/TLB misses.
+//
+// Every event is opened on its own, so a machine (or VM) that lacks some of
+// them still gets the others. If the kernel doesn't allow perf events at all
+// (perf_event_paranoid, seccomp in containers, no PMU) nothing is counted and
+// reason() says why. Only user space is counted, which is allowed with the
+// default perf_event_paranoid of 2.
+namespace perf {
+
+enum Event : std::size_t {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    L1D_MISSES,
+    LLC_MISSES,
+    DTLB_MISSES,
+    EVENT_COUNT
+};
+
+constexpr const char* NAMES[EVENT_COUNT] = {
+    "cycles",     "instructions", "branch_misses",
+    "l1d_misses", "llc_misses",   "dtlb_misses"};
+
+/**
+ * Counter values of one measurement (events that couldn't be opened are
+ * missing).
+ */
+struct Sample {
+    std::array<std::optional<double>, EVENT_COUNT> values;
+
+    std::optional<double> ipc() const {
+        if (values[CYCLES] && values[INSTRUCTIONS] && *values[CYCLES] > 0) {
+            return *values[INSTRUCTIONS] / *values[CYCLES];
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Every value divided by `n` (e.g. per iteration).
+     */
+    Sample per(double n) const {
+        Sample sample = *this;
+        for (std::optional<double>& value : sample.values) {
+            if (value) {
+                *value /= n;
+            }
+        }
+        return sample;
+    }
+};
+
+namespace detail {
+
+perf_event_attr make_attr(Event event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // to scale the values if the PMU is multiplexed between events
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    auto cache = [](std::uint64_t cache, std::uint64_t op) {
+        return cache | (op << 8) |
+               (std::uint64_t{PERF_COUNT_HW_CACHE_RESULT_MISS} << 16);
+    };
+    switch (event) {
+    case CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case BRANCH_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config =
+            cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ);
+        break;
+    case LLC_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config =
+            cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ);
+        break;
+    case EVENT_COUNT:
+        break;
+    }
+    return attr;
+}
+
+} // namespace detail
+
+/**
+ * The events of the thread that creates it. Measure with start() and
+ * stop(), the events keep counting only in between.
+ */
+class Counters {
+    std::array<int, EVENT_COUNT> fds;
+    std::string reason_;
+
+    struct Reading {
+        std::uint64_t value;
+        std::uint64_t enabled;
+        std::uint64_t running;
+    };
+
+    std::array<Reading, EVENT_COUNT> started{};
+
+    std::optional<Reading> read_event(Event event) const {
+        Reading reading;
+        if (fds[event] < 0 ||
+            ::read(fds[event], &reading, sizeof(reading)) !=
+                static_cast<ssize_t>(sizeof(reading))) {
+            return std::nullopt;
+        }
+        return reading;
+    }
+
+public:
+    Counters() {
+        fds.fill(-1);
+        for (std::size_t i = 0; i < EVENT_COUNT; ++i) {
+            perf_event_attr attr = detail::make_attr(static_cast<Event>(i));
+            fds[i] = static_cast<int>(
+                syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds[i] < 0 && reason_.empty()) {
+                reason_ = std::string("perf_event_open failed for ") +
+                          NAMES[i] + ": " + std::strerror(errno);
+            }
+        }
+    }
+
+    ~Counters() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    Counters(const Counters&) = delete;
+    Counters& operator=(const Counters&) = delete;
+
+    /**
+     * True if at least one event can be counted.
+     */
+    bool available() const {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Why (the first) event couldn't be opened, empty if all could.
+     */
+    const std::string& reason() const { return reason_; }
+
+    void start() {
+        for (std::size_t i = 0; i < EVENT_COUNT; ++i) {
+            if (std::optional<Reading> reading =
+                    read_event(static_cast<Event>(i))) {
+                started[i] = *reading;
+            }
+            if (fds[i] >= 0) {
+                ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    /**
+     * Counts since start(), scaled up if an event only ran for part of the
+     * time (multiplexing).
+     */
+    Sample stop() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        Sample sample;
+        for (std::size_t i = 0; i < EVENT_COUNT; ++i) {
+            std::optional<Reading> reading = read_event(static_cast<Event>(i));
+            if (!reading) {
+                continue;
+            }
+            const double value = reading->value - started[i].value;
+            const double enabled = reading->enabled - started[i].enabled;
+            const double running = reading->running - started[i].running;
+            // never scheduled on the PMU: no value rather than a wrong one
+            if (running > 0) {
+                sample.values[i] = value * enabled / running;
+            } else if (enabled == 0) {
+                sample.values[i] = 0.0;
+            }
+        }
+        return sample;
+    }
+};
+
+/**
+ * Runs `f` and returns its counters (empty if there are none).
+ */
+template <typename F> Sample measure(Counters& counters, F&& f) {
+    counters.start();
+    f();
+    return counters.stop();
+}
+
+/**
+ * Prints the values like `cycles=1.2e+06 instructions=... ipc=2.1` (`n/a` for
+ * missing values).
+ */
+void print(std::ostream& o, const Sample& sample) {
+    const auto flags = o.flags();
+    const auto precision = o.precision();
+    o << std::setprecision(4);
+    for (std::size_t i = 0; i < EVENT_COUNT; ++i) {
+        o << (i == 0 ? "" : " ") << NAMES[i] << '=';
+        if (sample.values[i]) {
+            o << *sample.values[i];
+        } else {
+            o << "n/a";
+        }
+        if (i == INSTRUCTIONS) {
+            o << " ipc=";
+            if (std::optional<double> ipc = sample.ipc()) {
+                o << *ipc;
+            } else {
+                o << "n/a";
+            }
+        }
+    }
+    o.flags(flags);
+    o.precision(precision);
+}
+
+} // namespace perf
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef JSON_QUERY_SELECTORS_EXPLAIN_HPP
+#define JSON_QUERY_SELECTORS_EXPLAIN_HPP
+
+#include <cstddef>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include "../utils.hpp"
+#include "types.hpp"
+
+// --explain and --explain-analyze: the selectors as a plan tree, optionally
+// with the counters of an evaluation.
+namespace selectors {
+
+/**
+ * One step of a chain in selector syntax (with the kind of the selector in
+ * front).
+ */
+std::string describe(const SelectorNode& node) {
+    std::ostringstream o;
+    o << node.name() << ' ';
+    auto print_bound = [&o](const boost::optional<int>& bound) {
+        if (bound) {
+            o << *bound;
+        }
+    };
+    boost::apply_visitor(
+        overloaded{
+            [&o](const KeySelector& s) { o << '"' << s.get() << '"'; },
+            [&o](const IndexSelector& s) { o << '[' << s.get() << ']'; },
+            [&o, &print_bound](const RangeSelector& s) {
+                o << '[';
+                print_bound(s.get_start());
+                o << ':';
+                print_bound(s.get_end());
+                o << ']';
+            },
+            [&o](const PropertySelector& s) {
+                o << '{';
+                const char* sep = "";
+                for (const std::string& key : s.get_keys()) {
+                    o << sep << '"' << key << '"';
+                    sep = ", ";
+                }
+                o << '}';
+            },
+            [&o](const FilterSelector& s) {
+                o << "|\"" << s.get().get() << '"';
+            },
+            [&o](const TruncateSelector&) { o << '!'; },
+            [&o](const FlattenSelector&) { o << ".."; },
+            [&o](const AnyRootSelector&) { o << '.'; },
+            [&o](const InvalidSelector&) { o << '?'; }},
+        node.inner);
+    return o.str();
+}
+
+/**
+ * Profile with all chains of the selectors. The selectors must not be
+ * changed or moved while it is used.
+ */
+std::unique_ptr<Profile> make_profile(const Selectors& selectors) {
+    auto profile = std::make_unique<Profile>();
+    for (const RootSelector& root : selectors.get()) {
+        profile->add(root.get());
+    }
+    return profile;
+}
+
+/**
+ * Prints the selectors as a tree: every root selector is a branch and every
+ * step of its chain is a child of the step before it (it is applied to each
+ * value the step before emits).
+ *
+ * With a profile (that was used for an evaluation) the counters of every
+ * step are printed after it. The time of a step includes the steps after it
+ * (`self` is without them) and the overhead of measuring it.
+ */
+void explain(std::ostream& o, const Selectors& selectors,
+             const Profile* profile = nullptr) {
+    const std::vector<RootSelector>& roots = selectors.get();
+    o << "Selectors (" << roots.size() << " root selector"
+      << (roots.size() == 1 ? "" : "s") << ")\n";
+
+    auto milliseconds = [](std::uint64_t nanoseconds) {
+        std::ostringstream ms;
+        ms << std::fixed << std::setprecision(3) << nanoseconds / 1e6;
+        return ms.str();
+    };
+
+    for (std::size_t r = 0; r < roots.size(); ++r) {
+        const std::vector<SelectorNode>& chain = roots[r].get();
+        o << "-> Root " << r << "\n";
+        for (std::size_t i = 0; i < chain.size(); ++i) {
+            o << std::string(3 * (i + 1), ' ') << "-> " << describe(chain[i]);
+            if (profile != nullptr) {
+                const Profile::Step& step = profile->get(r, i);
+                const std::uint64_t time = step.nanoseconds.load();
+                const std::uint64_t after =
+                    i + 1 < chain.size()
+                        ? profile->get(r, i + 1).nanoseconds.load()
+                        : 0;
+                o << "  (visited=" << step.visited.load()
+                  << " emitted=" << step.emitted.load()
+                  << " missed=" << step.missed.load()
+                  << " time=" << milliseconds(time) << " ms"
+                  << " self=" << milliseconds(time > after ? time - after : 0)
+                  << " ms)";
+            }
+            o << "\n";
+        }
+    }
+}
+
+} // namespace selectors
+
+#endif
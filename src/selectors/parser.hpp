@@ -139,9 +139,12 @@ struct selectors_grammar
 
 template <typename Iterator>
 Selectors parse_selectors(Iterator first, Iterator last) {
+    // building the grammar (all the rules) is expensive compared to parsing
+    // the selectors so every thread builds it only once
+    static thread_local const selectors_grammar<Iterator> grammar;
+
     Selectors selectors;
-    if (!qi::phrase_parse(first, last, selectors_grammar<Iterator>(),
-                          ascii::space, selectors)) {
+    if (!qi::phrase_parse(first, last, grammar, ascii::space, selectors)) {
         throw FailedToParseSelectorException("parser failed");
     }
 
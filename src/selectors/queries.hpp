@@ -0,0 +1,122 @@
+#ifndef JSON_QUERY_SELECTORS_QUERIES_HPP
+#define JSON_QUERY_SELECTORS_QUERIES_HPP
+
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../json/json.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "../trace/trace.hpp"
+#include "parser.hpp"
+#include "types.hpp"
+
+// Many independent queries (each a full selector string) against the same
+// document, so the document only has to be parsed once.
+namespace selectors {
+
+/**
+ * One query from a queries file.
+ */
+struct Query {
+    // (1 indexed) line in the queries file
+    std::size_t line;
+    std::string text;
+};
+
+/**
+ * A query that could not be parsed.
+ */
+class QueryError : public std::exception {
+    std::size_t line;
+    std::string what_;
+
+public:
+    QueryError(std::size_t line, const std::string& message)
+        : line(line),
+          what_("query on line " + std::to_string(line) + ": " + message) {}
+
+    std::size_t get_line() const { return line; }
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+/**
+ * Result of one query: either the output or an error message.
+ */
+struct QueryResult {
+    std::string output;
+    std::string error;
+};
+
+/**
+ * Reads queries, one per line. Empty lines are skipped.
+ */
+std::vector<Query> read_queries(std::istream& in) {
+    std::vector<Query> queries;
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(" \t") != std::string::npos) {
+            queries.push_back(Query{line_number, line});
+        }
+    }
+    return queries;
+}
+
+/**
+ * Parses all queries. Throws QueryError for the first query that is not a
+ * valid selector.
+ */
+std::vector<Selectors> compile_queries(const std::vector<Query>& queries) {
+    std::vector<Selectors> compiled;
+    compiled.reserve(queries.size());
+    for (const Query& query : queries) {
+        try {
+            compiled.push_back(parse_selectors(query.text));
+        } catch (const SyntaxError& e) {
+            throw QueryError(query.line, e.what());
+        } catch (const FailedToParseSelectorException& e) {
+            throw QueryError(query.line, e.what());
+        }
+    }
+    return compiled;
+}
+
+/**
+ * Applies every query to `json` and returns the results in the order of the
+ * queries.
+ *
+ * With a pool in `ctx` the queries are evaluated concurrently (and each of
+ * them can use the pool as well). A query that fails does not affect the
+ * others, its error message is returned instead of its output.
+ */
+std::vector<QueryResult> apply_queries(const json::JsonNode& json,
+                                       const std::vector<Selectors>& queries,
+                                       const ApplyContext& ctx) {
+    std::vector<QueryResult> results{queries.size()};
+    parallel::parallel_for(
+        ctx.pool, queries.size(),
+        [&json, &queries, &ctx, &results](std::size_t i) {
+            trace::Span span("query", "index", i);
+            try {
+                std::ostringstream out;
+                out << queries[i].apply(json, ctx);
+                results[i].output = out.str();
+            } catch (const ApplySelectorError& e) {
+                results[i].error = e.what();
+            }
+        });
+    return results;
+}
+
+} // namespace selectors
+
+#endif
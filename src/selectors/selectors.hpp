@@ -1,3 +1,4 @@
+#include "explain.hpp"
 #include "parser.hpp"
 #include "types.hpp"
 
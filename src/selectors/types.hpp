@@ -3,13 +3,22 @@
 
 #include <boost/optional.hpp>
 #include <boost/variant.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "../counters/counters.hpp"
 #include "../json/json.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "../trace/trace.hpp"
 #include "../utils.hpp"
 
 namespace selectors {
@@ -25,6 +34,65 @@ public:
     const char* what() const noexcept override { return message.c_str(); }
 };
 
+/**
+ * Reason why a selector could not be applied to a json item.
+ *
+ * Creating one is cheap (no allocation) because e.g. FilterSelector gets one
+ * for every object that does not contain the key. The message is only put
+ * together when the error is actually reported.
+ */
+class ApplyError {
+public:
+    enum Kind { KEY_NOT_FOUND, INDEX_OUT_OF_RANGE, MISMATCH };
+
+private:
+    Kind kind;
+    // the key that was not found (points into the selector)
+    const std::string* key = nullptr;
+    int index = 0;
+    const char* selector_name = nullptr;
+    const char* json_name = nullptr;
+
+    explicit ApplyError(Kind kind) : kind(kind) {}
+
+public:
+    static ApplyError key_not_found(const std::string& key) {
+        ApplyError e(KEY_NOT_FOUND);
+        e.key = &key;
+        return e;
+    }
+
+    static ApplyError index_out_of_range(int index) {
+        ApplyError e(INDEX_OUT_OF_RANGE);
+        e.index = index;
+        return e;
+    }
+
+    static ApplyError mismatch(const char* selector_name,
+                               const char* json_name) {
+        ApplyError e(MISMATCH);
+        e.selector_name = selector_name;
+        e.json_name = json_name;
+        return e;
+    }
+
+    Kind get_kind() const { return kind; }
+
+    std::string message() const {
+        switch (kind) {
+        case KEY_NOT_FOUND:
+            return "Key \"" + *key + "\" was not found in json object";
+        case INDEX_OUT_OF_RANGE:
+            return "Index " + std::to_string(index) +
+                   " is out of range of json array";
+        case MISMATCH:
+            return std::string("selector and json object don't match: ") +
+                   selector_name + ", " + json_name;
+        }
+        return "";
+    }
+};
+
 class SelectorNode;
 
 // Used to detect wrong parsing because the default constructor of the
@@ -427,6 +495,151 @@ void extend_vec_with(std::vector<T>& vec, const std::vector<T>& extension) {
     vec.insert(vec.end(), extension.begin(), extension.end());
 }
 
+/**
+ * Counters of every step of the selector chains for --explain-analyze.
+ *
+ * A step is identified by the address of its SelectorNode (or of the
+ * selector inside it), so the counters can be found from inside any
+ * apply_selector overload without passing step numbers around. The counters
+ * are atomic because the items of large arrays are processed in parallel.
+ */
+class Profile {
+public:
+    struct Step {
+        // values the step was applied to
+        std::atomic<std::uint64_t> visited{0};
+        // values the step handed on to the next step (or returned at the end)
+        std::atomic<std::uint64_t> emitted{0};
+        // keys that were not found
+        std::atomic<std::uint64_t> missed{0};
+        // time spent in the step including the steps after it
+        std::atomic<std::uint64_t> nanoseconds{0};
+    };
+
+private:
+    struct Chain {
+        const SelectorNode* begin;
+        std::size_t size;
+        std::unique_ptr<Step[]> steps;
+    };
+
+    std::vector<Chain> chains;
+
+    // chain and position (0 to size) of a step, the position `size` is the
+    // end of the chain
+    std::pair<Chain*, std::size_t> locate(const void* p) {
+        const auto* byte = static_cast<const std::byte*>(p);
+        for (Chain& chain : chains) {
+            const auto* begin = reinterpret_cast<const std::byte*>(chain.begin);
+            const auto* end =
+                reinterpret_cast<const std::byte*>(chain.begin + chain.size);
+            if (begin <= byte && byte <= end) {
+                return {&chain, (byte - begin) / sizeof(SelectorNode)};
+            }
+        }
+        return {nullptr, 0};
+    }
+
+public:
+    /**
+     * Adds a chain of selectors. The chain must not be moved anymore.
+     */
+    void add(const std::vector<SelectorNode>& chain) {
+        chains.push_back(Chain{chain.data(), chain.size(),
+                               std::make_unique<Step[]>(chain.size())});
+    }
+
+    /**
+     * Counters of step `step` of chain `chain` (in the order they were
+     * added).
+     */
+    const Step& get(std::size_t chain, std::size_t step) const {
+        return chains[chain].steps[step];
+    }
+
+    /**
+     * Runs `apply` (applying the step at `position` and everything after
+     * it) and counts it.
+     */
+    template <typename F> auto record(const SelectorNode* position, F&& apply) {
+        auto [chain, index] = locate(position);
+        if (chain == nullptr) {
+            return apply();
+        }
+        if (index > 0) {
+            chain->steps[index - 1].emitted.fetch_add(
+                1, std::memory_order_relaxed);
+        }
+        if (index == chain->size) {
+            return apply();
+        }
+        Step& step = chain->steps[index];
+        step.visited.fetch_add(1, std::memory_order_relaxed);
+        const auto start = std::chrono::steady_clock::now();
+        auto result = apply();
+        step.nanoseconds.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count(),
+            std::memory_order_relaxed);
+        return result;
+    }
+
+    /**
+     * Counts a key that was not found by the selector at `selector` (which
+     * is inside a SelectorNode of one of the chains).
+     */
+    void miss(const void* selector) {
+        auto [chain, index] = locate(selector);
+        if (chain != nullptr && index < chain->size) {
+            chain->steps[index].missed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * Settings shared by all apply_selector calls of one evaluation.
+ */
+struct ApplyContext {
+    // pool used to process large arrays in parallel (nullptr means serial)
+    parallel::ThreadPool* pool = nullptr;
+    // arrays with fewer items than this are always processed serially so
+    // small inputs don't pay for the synchronization
+    std::size_t parallel_threshold = 4096;
+    // counters for --explain-analyze (nullptr means nothing is counted)
+    Profile* profile = nullptr;
+};
+
+/**
+ * Result of applying (the rest of) a selector chain.
+ *
+ * Errors are returned instead of thrown because some selectors (e.g.
+ * FilterSelector) expect most of their sub chains to fail.
+ */
+using ApplyResult = Expected<JsonNode, ApplyError>;
+
+/**
+ * Remembers the error of the item with the lowest index when the items of an
+ * array are processed in parallel. So the reported error is the same as with
+ * serial processing.
+ */
+class FirstError {
+    std::mutex mutex;
+    std::optional<std::pair<std::size_t, ApplyError>> first;
+
+public:
+    void record(std::size_t index, const ApplyError& error) {
+        std::lock_guard lock(mutex);
+        if (!first || index < first->first) {
+            first.emplace(index, error);
+        }
+    }
+
+    const std::optional<std::pair<std::size_t, ApplyError>>& get() const {
+        return first;
+    }
+};
+
 // these template functions make it a little easier to find and extend what
 // selector handles what json item
 //
@@ -434,84 +647,119 @@ void extend_vec_with(std::vector<T>& vec, const std::vector<T>& extension) {
 // hassle to resolve the "define before use" dependencies
 
 template <sel_iter I>
-JsonNode apply_selector(const FlattenSelector& /*unused*/, const JsonArray& arr,
-                        I next, I end) {
-    std::vector<JsonNode> flattened_array;
+ApplyResult apply_selector(const FlattenSelector& /*unused*/,
+                           const JsonArray& arr, I next, I end,
+                           const ApplyContext& ctx) {
+    const std::vector<JsonNode>& items = arr.get();
+
+    FirstError error;
+    std::vector<JsonNode> flattened_array = parallel::parallel_concat<JsonNode>(
+        ctx.pool, items.size(), ctx.parallel_threshold,
+        [&items, &error, next, end, &ctx](std::size_t first, std::size_t last,
+                                          std::vector<JsonNode>& out) {
+            for (std::size_t i = first; i < last; ++i) {
+                // calculate sub result and flatten if result is an array
+                const ApplyResult result =
+                    apply_selector(items[i], next, end, ctx);
+                if (!result) {
+                    error.record(i, result.error());
+                    return;
+                }
+                result->apply_visitor(
+                    overloaded{[&out](const JsonArray& nested_array) {
+                                   extend_vec_with(out, nested_array.get());
+                               },
+                               [](const is_json_item auto& /*unused*/) {}});
+            }
+        });
 
-    for (const JsonNode& item : arr.get()) {
-        // calculate sub result and flatten if result is an array
-        const JsonNode result = apply_selector(item, next, end);
-        result.apply_visitor(
-            overloaded{[&flattened_array](const JsonArray& nested_array) {
-                           extend_vec_with(flattened_array, nested_array.get());
-                       },
-                       [](const is_json_item auto& /*unused*/) {}});
+    if (error.get()) {
+        return Unexpected(error.get()->second);
     }
-
     return JsonNode(JsonArray(flattened_array));
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const TruncateSelector& /*unused*/,
-                        const JsonObject& /*unused*/, I /*unused*/,
-                        I /*unused*/) {
+ApplyResult apply_selector(const TruncateSelector& /*unused*/,
+                           const JsonObject& /*unused*/, I /*unused*/,
+                           I /*unused*/, const ApplyContext& /*unused*/) {
     return JsonNode(JsonObject());
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const TruncateSelector& /*unused*/,
-                        const JsonArray& /*unused*/, I /*unused*/,
-                        I /*unused*/) {
+ApplyResult apply_selector(const TruncateSelector& /*unused*/,
+                           const JsonArray& /*unused*/, I /*unused*/,
+                           I /*unused*/, const ApplyContext& /*unused*/) {
     return JsonNode(JsonArray());
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const TruncateSelector& /*unused*/,
-                        const is_json_item auto& json, I /*unused*/,
-                        I /*unused*/) {
+ApplyResult apply_selector(const TruncateSelector& /*unused*/,
+                           const is_json_item auto& json, I /*unused*/,
+                           I /*unused*/, const ApplyContext& /*unused*/) {
     return JsonNode(json);
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const FilterSelector& s, const JsonArray& arr, I next,
-                        I end) {
-    std::vector<JsonNode> result;
-
-    for (const JsonNode& item : arr.get()) {
-        try {
-            // only check JsonObjects and ignore all other items
-            item.apply_visitor(overloaded{
-                [&result, &next, &end, key = s.get()](const JsonObject& obj) {
-                    result.push_back(apply_selector(key, obj, next, end));
-                },
-                [](const is_json_item auto& /*unused*/) {}});
-        } catch (const ApplySelectorError&) {
-            // note: this means th key was not found and thus we ignore the item
-        }
-    }
+ApplyResult apply_selector(const FilterSelector& s, const JsonArray& arr,
+                           I next, I end, const ApplyContext& ctx) {
+    const std::vector<JsonNode>& items = arr.get();
+
+    std::vector<JsonNode> result = parallel::parallel_concat<JsonNode>(
+        ctx.pool, items.size(), ctx.parallel_threshold,
+        [&items, &s, next, end, &ctx](std::size_t first, std::size_t last,
+                                      std::vector<JsonNode>& out) {
+            for (std::size_t i = first; i < last; ++i) {
+                // only check JsonObjects and ignore all other items
+                items[i].apply_visitor(overloaded{
+                    [&out, &next, &end, &ctx,
+                     &key = s.get()](const JsonObject& obj) {
+                        ApplyResult sub =
+                            apply_selector(key, obj, next, end, ctx);
+                        // an error means the key was not found (or the rest
+                        // of the chain didn't match) and thus we ignore the
+                        // item
+                        if (sub) {
+                            counters::push_back(out, std::move(*sub));
+                        }
+                    },
+                    [](const is_json_item auto& /*unused*/) {}});
+            }
+        });
 
     return JsonNode(JsonArray(result));
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const PropertySelector& s, const JsonObject& obj,
-                        I next, I end) {
+ApplyResult apply_selector(const PropertySelector& s, const JsonObject& obj,
+                           I next, I end, const ApplyContext& ctx) {
     const std::vector<std::string>& keys = s.get_keys();
-    // initialize with correct size so we don't need back_inserter
-    std::vector<std::pair<std::string, JsonNode>> result{keys.size()};
-
-    std::ranges::transform(
-        keys, result.begin(), [&obj, next, end](const std::string& key) {
-            return std::make_pair(key,
-                                  apply_selector(obj.find(key), next, end));
-        });
+    std::vector<std::pair<std::string, JsonNode>> result;
+    result.reserve(keys.size());
+
+    for (const std::string& key : keys) {
+        const JsonNode* value = obj.find(key);
+        counters::add(counters::KEY_LOOKUPS);
+        if (value == nullptr) {
+            counters::add(counters::KEY_MISSES);
+            if (ctx.profile != nullptr) {
+                ctx.profile->miss(&s);
+            }
+            return Unexpected(ApplyError::key_not_found(key));
+        }
+        ApplyResult sub = apply_selector(*value, next, end, ctx);
+        if (!sub) {
+            return sub;
+        }
+        result.emplace_back(key, std::move(*sub));
+    }
 
     return JsonNode(JsonObject(result));
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const RangeSelector& s, const JsonArray& array, I next,
-                        I end) {
+ApplyResult apply_selector(const RangeSelector& s, const JsonArray& array,
+                           I next, I end, const ApplyContext& ctx) {
     const std::vector<JsonNode>& arr = array.get();
 
     // range start and end or default values
@@ -519,53 +767,75 @@ JsonNode apply_selector(const RangeSelector& s, const JsonArray& array, I next,
     const auto range_end = s.get_end().get_value_or(arr.size() - 1) + 1;
 
     auto begin_it = arr.cbegin() + range_start;
-    auto end_it = arr.cbegin() + range_end;
 
     const unsigned long num_items = range_end - range_start;
 
-    std::vector<JsonNode> result{num_items};
-    std::transform(begin_it, end_it, result.begin(),
-                   [next, end](const JsonNode& item) {
-                       return apply_selector(item, next, end);
-                   });
+    FirstError error;
+    std::vector<JsonNode> result = parallel::parallel_concat<JsonNode>(
+        ctx.pool, num_items, ctx.parallel_threshold,
+        [begin_it, &error, next, end, &ctx](std::size_t first,
+                                            std::size_t last,
+                                            std::vector<JsonNode>& out) {
+            out.reserve(out.size() + (last - first));
+            for (std::size_t i = first; i < last; ++i) {
+                ApplyResult sub =
+                    apply_selector(*(begin_it + i), next, end, ctx);
+                if (!sub) {
+                    error.record(i, sub.error());
+                    return;
+                }
+                out.push_back(std::move(*sub));
+            }
+        });
 
-    return {JsonArray{result}};
+    if (error.get()) {
+        return Unexpected(error.get()->second);
+    }
+    return JsonNode(JsonArray(result));
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const IndexSelector& s, const JsonArray& arr, I next,
-                        I end) {
-    return apply_selector(arr.at(s.get()), next, end);
+ApplyResult apply_selector(const IndexSelector& s, const JsonArray& arr,
+                           I next, I end, const ApplyContext& ctx) {
+    const int index = s.get();
+    if (index < 0 || static_cast<std::size_t>(index) >= arr.get().size()) {
+        return Unexpected(ApplyError::index_out_of_range(index));
+    }
+    return apply_selector(arr.get()[index], next, end, ctx);
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const KeySelector& s, const JsonObject& obj, I next,
-                        I end) {
-    try {
-        return apply_selector(obj.find(s.get()), next, end);
-    } catch (std::out_of_range&) {
-        throw ApplySelectorError("Key \"" + s.get() +
-                                 "\" was not found in json object");
+ApplyResult apply_selector(const KeySelector& s, const JsonObject& obj, I next,
+                           I end, const ApplyContext& ctx) {
+    const JsonNode* value = obj.find(s.get());
+    counters::add(counters::KEY_LOOKUPS);
+    if (value == nullptr) {
+        counters::add(counters::KEY_MISSES);
+        if (ctx.profile != nullptr) {
+            ctx.profile->miss(&s);
+        }
+        return Unexpected(ApplyError::key_not_found(s.get()));
     }
+    return apply_selector(*value, next, end, ctx);
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const AnyRootSelector& /*unused*/,
-                        const is_json_item auto& json, I next, I end) {
-    return apply_selector(json, next, end);
+ApplyResult apply_selector(const AnyRootSelector& /*unused*/,
+                           const is_json_item auto& json, I next, I end,
+                           const ApplyContext& ctx) {
+    return apply_selector(json, next, end, ctx);
 }
 
 template <sel_iter I>
-JsonNode apply_selector(const is_selector auto& s, const is_json_item auto& j,
-                        I /*unused*/, I /*unused*/) {
-    throw ApplySelectorError(
-        std::string("selector and json object don't match: ") + s.name() +
-        ", " + j.name());
+ApplyResult apply_selector(const is_selector auto& s,
+                           const is_json_item auto& j, I /*unused*/,
+                           I /*unused*/, const ApplyContext& /*unused*/) {
+    return Unexpected(ApplyError::mismatch(s.name(), j.name()));
 }
 
-// entry point for applying the next selector
 template <sel_iter I>
-JsonNode apply_selector(const JsonNode& json, I next, I end) {
+ApplyResult apply_next_selector(const JsonNode& json, I next, I end,
+                                const ApplyContext& ctx) {
     if (next == end) {
         return JsonNode(json);
     }
@@ -573,12 +843,28 @@ JsonNode apply_selector(const JsonNode& json, I next, I end) {
     const SelectorNode& next_s = *next;
     next++;
     return json.apply_visitor(
-        [&next, &end](is_json_item auto& item, is_selector auto& selector) {
-            return apply_selector(selector, item, next, end);
+        [&next, &end, &ctx](is_json_item auto& item,
+                            is_selector auto& selector) {
+            return apply_selector(selector, item, next, end, ctx);
         },
         next_s.inner);
 }
 
+// entry point for applying the next selector
+template <sel_iter I>
+ApplyResult apply_selector(const JsonNode& json, I next, I end,
+                           const ApplyContext& ctx) {
+    // the chains are always vectors, the check is only for the type system
+    if constexpr (std::contiguous_iterator<I>) {
+        if (ctx.profile != nullptr) {
+            return ctx.profile->record(std::to_address(next), [&] {
+                return apply_next_selector(json, next, end, ctx);
+            });
+        }
+    }
+    return apply_next_selector(json, next, end, ctx);
+}
+
 /**
  * Contains a list of sequential selectors.
  *
@@ -595,7 +881,26 @@ public:
     const std::vector<SelectorNode>& get() const { return inner; }
 
     JsonNode apply(const JsonNode& json) const {
-        return apply_selector(json, inner.cbegin(), inner.cend());
+        return apply(json, ApplyContext{});
+    }
+
+    /**
+     * Throws ApplySelectorError if the selector can't be applied to the json.
+     */
+    JsonNode apply(const JsonNode& json, const ApplyContext& ctx) const {
+        ApplyResult result = try_apply(json, ctx);
+        if (!result) {
+            counters::add(counters::EXCEPTIONS);
+            throw ApplySelectorError(result.error().message());
+        }
+        return std::move(*result);
+    }
+
+    /**
+     * Like apply but returns the error instead of throwing it.
+     */
+    ApplyResult try_apply(const JsonNode& json, const ApplyContext& ctx) const {
+        return apply_selector(json, inner.cbegin(), inner.cend(), ctx);
     }
 
     friend std::ostream& operator<<(std::ostream& o, const RootSelector& self) {
@@ -632,18 +937,71 @@ public:
      * the json.
      */
     JsonNode apply(const JsonNode& json) const {
+        return apply(json, ApplyContext{});
+    }
+
+    /**
+     * Apply all the selectors to the given Json using the given pool.
+     *
+     * If `pool` is `nullptr` this is the same as `apply(json)`.
+     */
+    JsonNode apply(const JsonNode& json, parallel::ThreadPool* pool) const {
+        return apply(json, ApplyContext{.pool = pool});
+    }
+
+    /**
+     * Apply all the selectors to the given Json with the given settings.
+     *
+     * The root selectors are independent of each other and the json is not
+     * modified so with a pool they are evaluated concurrently. Each result is
+     * written to its own slot so the output order is the same as with serial
+     * evaluation. Large arrays are additionally split up between the threads
+     * by the array selectors (see ApplyContext).
+     */
+    JsonNode apply(const JsonNode& json, const ApplyContext& ctx) const {
+        return apply_each(ctx, [&json, &ctx](const RootSelector& selector) {
+            return selector.try_apply(json, ctx);
+        });
+    }
+
+    /**
+     * Calls `try_apply(root_selector)` for all root selectors (in parallel
+     * with the pool from `ctx`) and combines the results like apply.
+     *
+     * Used to evaluate the selectors on other representations of the json
+     * than JsonNode.
+     *
+     * Throws ApplySelectorError with the error of the first root selector
+     * that failed.
+     */
+    template <typename TryApply>
+    JsonNode apply_each(const ApplyContext& ctx,
+                        const TryApply& try_apply) const {
         if (selectors.empty()) {
             return JsonNode(JsonLiteral(JSON_NULL));
-        } else if (selectors.size() == 1) {
-            return selectors[0].apply(json);
-        } else {
-            auto apply = [&json](const RootSelector& selector) {
-                return selector.apply(json);
-            };
-            std::vector<JsonNode> array;
-            ranges::transform(selectors, std::back_inserter(array), apply);
-            return JsonNode(JsonArray(array));
         }
+
+        std::vector<std::optional<ApplyResult>> results{selectors.size()};
+        parallel::parallel_for(
+            ctx.pool, selectors.size(),
+            [this, &try_apply, &results](std::size_t i) {
+                trace::Span span("root_selector", "index", i);
+                results[i].emplace(try_apply(selectors[i]));
+            });
+
+        std::vector<JsonNode> array;
+        array.reserve(results.size());
+        for (std::optional<ApplyResult>& result : results) {
+            if (!*result) {
+                counters::add(counters::EXCEPTIONS);
+                throw ApplySelectorError(result->error().message());
+            }
+            array.push_back(std::move(**result));
+        }
+        if (array.size() == 1) {
+            return std::move(array.front());
+        }
+        return JsonNode(JsonArray(array));
     }
 
     friend std::ostream& operator<<(std::ostream& o, const Selectors& self) {
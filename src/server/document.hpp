@@ -0,0 +1,66 @@
+#ifndef JSON_QUERY_SERVER_DOCUMENT_HPP
+#define JSON_QUERY_SERVER_DOCUMENT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "../json/json.hpp"
+
+namespace server {
+
+/**
+ * The document a Server answers queries on. It can be replaced while queries
+ * are running (read-copy-update).
+ *
+ * Readers take a snapshot with get() and keep using it until they are done,
+ * even if the document is replaced in the meantime. A version is freed when
+ * the last snapshot of it is released.
+ *
+ * NOTE: std::atomic<std::shared_ptr> is not lock-free in libstdc++, loads and
+ * stores take a short internal lock. It is only held while the pointer is
+ * copied though, never while a query runs or a document is parsed, so reloads
+ * and queries only wait for each other for that long.
+ */
+class Document {
+    std::atomic<std::shared_ptr<const json::JsonNode>> current;
+    std::atomic<std::size_t> version{1};
+
+public:
+    explicit Document(json::JsonNode json)
+        : current(std::make_shared<const json::JsonNode>(std::move(json))) {}
+
+    Document(const Document&) = delete;
+    Document& operator=(const Document&) = delete;
+
+    /**
+     * Snapshot of the current version.
+     */
+    std::shared_ptr<const json::JsonNode> get() const {
+        return current.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Number of the current version (starts at 1, incremented by every
+     * replace()).
+     */
+    std::size_t get_version() const { return version.load(); }
+
+    /**
+     * Makes `json` the current version.
+     *
+     * If no query uses the old version anymore it is destroyed on the calling
+     * thread, otherwise the last query holding it frees it when it is done.
+     */
+    void replace(json::JsonNode json) {
+        std::shared_ptr<const json::JsonNode> old = current.exchange(
+            std::make_shared<const json::JsonNode>(std::move(json)),
+            std::memory_order_acq_rel);
+        version.fetch_add(1);
+    }
+};
+
+} // namespace server
+
+#endif
@@ -0,0 +1,454 @@
+#ifndef JSON_QUERY_SERVER_SERVER_HPP
+#define JSON_QUERY_SERVER_SERVER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../json/json.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "../selectors/selectors.hpp"
+#include "document.hpp"
+
+// Query daemon: the document is parsed once and then selectors are answered
+// over a UNIX domain socket.
+//
+// Protocol (all lengths are 32 bit unsigned big endian):
+//
+// - request: length, selector string
+// - response: status byte (0 = ok, 1 = error), length, result json or error
+//   message
+//
+// A client can send any number of requests over one connection, they are
+// answered in order.
+namespace server {
+
+/**
+ * Error of the socket communication (with the message of `errno`).
+ */
+class ServerError : public std::exception {
+    std::string what_;
+
+public:
+    ServerError(const std::string& message) : what_(message) {}
+
+    static ServerError from_errno(const std::string& action) {
+        return ServerError(action + ": " + std::strerror(errno));
+    }
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+enum class Status : std::uint8_t { OK = 0, ERROR = 1 };
+
+// requests are selectors so anything larger than this is garbage
+constexpr std::uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+/**
+ * Writes all of `data` to the socket. Returns false if the connection is
+ * closed.
+ */
+bool write_all(int fd, const void* data, std::size_t size) {
+    const char* pos = static_cast<const char*>(data);
+    while (size > 0) {
+        // MSG_NOSIGNAL: no SIGPIPE if the other side is gone
+        const ssize_t written = send(fd, pos, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        pos += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * Reads exactly `size` bytes from the socket. Returns false if the
+ * connection is closed before that.
+ */
+bool read_exact(int fd, void* data, std::size_t size) {
+    char* pos = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t got = read(fd, pos, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        pos += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool write_length(int fd, std::uint32_t length) {
+    const unsigned char bytes[4] = {
+        static_cast<unsigned char>(length >> 24),
+        static_cast<unsigned char>(length >> 16),
+        static_cast<unsigned char>(length >> 8),
+        static_cast<unsigned char>(length)};
+    return write_all(fd, bytes, sizeof(bytes));
+}
+
+std::optional<std::uint32_t> read_length(int fd) {
+    unsigned char bytes[4];
+    if (!read_exact(fd, bytes, sizeof(bytes))) {
+        return std::nullopt;
+    }
+    return std::uint32_t{bytes[0]} << 24 | std::uint32_t{bytes[1]} << 16 |
+           std::uint32_t{bytes[2]} << 8 | std::uint32_t{bytes[3]};
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw ServerError("socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+/**
+ * Applies a selector string to the document and returns the status and the
+ * result (or the error message).
+ */
+std::pair<Status, std::string> answer(const json::JsonNode& json,
+                                      const std::string& selector,
+                                      const selectors::ApplyContext& ctx) {
+    try {
+        std::ostringstream out;
+        out << selectors::parse_selectors(selector).apply(json, ctx);
+        return {Status::OK, out.str()};
+    } catch (const selectors::SyntaxError& e) {
+        return {Status::ERROR, std::string("invalid selector: ") + e.what()};
+    } catch (const selectors::FailedToParseSelectorException& e) {
+        return {Status::ERROR, std::string("invalid selector: ") + e.what()};
+    } catch (const selectors::ApplySelectorError& e) {
+        return {Status::ERROR, e.what()};
+    }
+}
+
+/**
+ * Answers queries on a UNIX socket until stop() is called.
+ *
+ * Every connection is handled by a task on a pool of its own with one thread
+ * per thread of the query pool (so the number of threads bounds the number of
+ * clients served at the same time), without a pool the connections are
+ * handled one after another. The connections don't run on the query pool
+ * because a query waiting for its parallel parts would pick up the task of
+ * another connection and then wait until that client disconnects.
+ *
+ * Every query takes a snapshot of the document, so it is answered with the
+ * version that was current when it arrived even if the document is replaced
+ * meanwhile.
+ */
+class Server {
+    const Document& document;
+    selectors::ApplyContext ctx;
+    std::string path;
+    int listen_fd = -1;
+
+    // open connections so stop() can close them
+    std::mutex mutex;
+    std::condition_variable closed;
+    std::set<int> connections;
+    bool stopping = false;
+
+    // runs handle() for every connection, destroyed first so no connection
+    // outlives the members above
+    std::unique_ptr<parallel::ThreadPool> connection_pool;
+
+public:
+    /**
+     * Creates the socket at `path` (a stale socket file from an earlier run
+     * is replaced).
+     *
+     * @throws ServerError if the socket can't be created
+     */
+    Server(const Document& document, const std::string& path,
+           const selectors::ApplyContext& ctx)
+        : document(document), ctx(ctx), path(path) {
+        if (ctx.pool != nullptr) {
+            connection_pool =
+                std::make_unique<parallel::ThreadPool>(ctx.pool->size() + 1);
+        }
+        const sockaddr_un address = socket_address(path);
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            throw ServerError::from_errno("socket");
+        }
+        unlink(path.c_str());
+        if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address),
+                 sizeof(address)) < 0 ||
+            listen(listen_fd, SOMAXCONN) < 0) {
+            const ServerError error = ServerError::from_errno("bind " + path);
+            close(listen_fd);
+            throw error;
+        }
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+
+    /**
+     * Accepts connections until stop() is called and then waits until all
+     * connections are closed.
+     */
+    void serve() {
+        while (true) {
+            const int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                std::unique_lock lock(mutex);
+                if (stopping) {
+                    closed.wait(lock, [this] { return connections.empty(); });
+                    return;
+                }
+                throw ServerError::from_errno("accept");
+            }
+            {
+                std::unique_lock lock(mutex);
+                if (stopping) {
+                    close(fd);
+                    closed.wait(lock, [this] { return connections.empty(); });
+                    return;
+                }
+                connections.insert(fd);
+            }
+            if (connection_pool) {
+                connection_pool->submit([this, fd] { handle(fd); });
+            } else {
+                handle(fd);
+            }
+        }
+    }
+
+    /**
+     * Makes serve() return and closes all connections. Can be called from any
+     * thread.
+     */
+    void stop() {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        // wakes up accept() (and the reads of the connections)
+        shutdown(listen_fd, SHUT_RDWR);
+        for (int fd : connections) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+private:
+    /**
+     * Writes one response. Returns false if the connection is closed.
+     */
+    static bool respond(int fd, Status status, const std::string& response) {
+        const std::uint8_t status_byte = static_cast<std::uint8_t>(status);
+        return write_all(fd, &status_byte, 1) &&
+               write_length(fd, response.size()) &&
+               write_all(fd, response.data(), response.size());
+    }
+
+    /**
+     * Answers the requests of one connection until it is closed. If anything
+     * unexpected fails (e.g. out of memory) the error is sent and only this
+     * connection is closed.
+     */
+    void handle(int fd) {
+        try {
+            std::string request;
+            while (true) {
+                std::optional<std::uint32_t> length = read_length(fd);
+                if (!length || *length > MAX_REQUEST_SIZE) {
+                    break;
+                }
+                request.resize(*length);
+                if (!read_exact(fd, request.data(), request.size())) {
+                    break;
+                }
+
+                auto [status, response] =
+                    answer(*document.get(), request, ctx);
+                if (!respond(fd, status, response)) {
+                    break;
+                }
+            }
+        } catch (const std::exception& e) {
+            respond(fd, Status::ERROR,
+                    std::string("internal server error: ") + e.what());
+        }
+
+        std::lock_guard lock(mutex);
+        connections.erase(fd);
+        close(fd);
+        closed.notify_all();
+    }
+};
+
+/**
+ * Connection to a Server.
+ */
+class Client {
+    int fd = -1;
+
+public:
+    /**
+     * @throws ServerError if there is no server listening on `path`
+     */
+    explicit Client(const std::string& path) {
+        const sockaddr_un address = socket_address(path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw ServerError::from_errno("socket");
+        }
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                    sizeof(address)) < 0) {
+            const ServerError error =
+                ServerError::from_errno("connect " + path);
+            close(fd);
+            throw error;
+        }
+    }
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client() { close(fd); }
+
+    /**
+     * Sends a selector and waits for the answer.
+     *
+     * @throws ServerError if the connection is lost
+     */
+    std::pair<Status, std::string> query(const std::string& selector) {
+        if (!write_length(fd, selector.size()) ||
+            !write_all(fd, selector.data(), selector.size())) {
+            throw ServerError("connection to server lost");
+        }
+        std::uint8_t status;
+        std::optional<std::uint32_t> length;
+        std::string response;
+        if (!read_exact(fd, &status, 1) || !(length = read_length(fd))) {
+            throw ServerError("connection to server lost");
+        }
+        response.resize(*length);
+        if (!read_exact(fd, response.data(), response.size())) {
+            throw ServerError("connection to server lost");
+        }
+        return {static_cast<Status>(status), std::move(response)};
+    }
+};
+
+/**
+ * Latencies measured by run_load.
+ */
+struct LoadStats {
+    std::size_t requests = 0;
+    std::size_t errors = 0;
+    double seconds = 0;
+    std::chrono::nanoseconds p50{0};
+    std::chrono::nanoseconds p99{0};
+    std::chrono::nanoseconds max{0};
+};
+
+/**
+ * Load generator: `clients` threads with a connection each send `selector`
+ * `requests` times in total (one request at a time per connection) and the
+ * latency of every request is recorded.
+ *
+ * @throws ServerError if a client can't connect or loses the connection
+ */
+LoadStats run_load(const std::string& path, const std::string& selector,
+                   std::size_t clients, std::size_t requests) {
+    clients = std::max(clients, std::size_t{1});
+    std::vector<std::vector<std::chrono::nanoseconds>> latencies(clients);
+    std::vector<std::size_t> errors(clients, 0);
+    std::vector<std::exception_ptr> failures(clients);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t c = 0; c < clients; ++c) {
+        // spread the requests evenly
+        const std::size_t count =
+            requests / clients + (c < requests % clients ? 1 : 0);
+        threads.emplace_back([&, c, count] {
+            try {
+                Client client(path);
+                latencies[c].reserve(count);
+                for (std::size_t i = 0; i < count; ++i) {
+                    const auto before = std::chrono::steady_clock::now();
+                    auto [status, response] = client.query(selector);
+                    latencies[c].push_back(std::chrono::steady_clock::now() -
+                                           before);
+                    if (status != Status::OK) {
+                        ++errors[c];
+                    }
+                }
+            } catch (...) {
+                failures[c] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    for (std::exception_ptr& failure : failures) {
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    std::vector<std::chrono::nanoseconds> all;
+    all.reserve(requests);
+    LoadStats stats;
+    for (std::size_t c = 0; c < clients; ++c) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        stats.errors += errors[c];
+    }
+    std::sort(all.begin(), all.end());
+    stats.requests = all.size();
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    if (!all.empty()) {
+        auto percentile = [&all](double p) {
+            return all[std::min(all.size() - 1,
+                                static_cast<std::size_t>(p * all.size()))];
+        };
+        stats.p50 = percentile(0.5);
+        stats.p99 = percentile(0.99);
+        stats.max = all.back();
+    }
+    return stats;
+}
+
+} // namespace server
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef JSON_QUERY_SERVER_WATCHER_HPP
+#define JSON_QUERY_SERVER_WATCHER_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+namespace server {
+
+/**
+ * Calls a function on a background thread every time a file was changed
+ * (uses inotify, so linux only).
+ *
+ * The directory of the file is watched instead of the file itself so that
+ * files that are replaced by renaming a new version over them (like most
+ * editors and deployment tools do) are noticed as well. Only completed
+ * writes are reported, not every single write.
+ */
+class FileWatcher {
+    std::string name;
+    std::function<void()> on_change;
+    int inotify_fd = -1;
+    // written to by the destructor to wake up the thread
+    int stop_fd = -1;
+    std::thread thread;
+
+public:
+    /**
+     * @throws ServerError if the file can't be watched
+     */
+    FileWatcher(const std::string& path, std::function<void()> on_change)
+        : name(std::filesystem::path(path).filename().string()),
+          on_change(std::move(on_change)) {
+        std::string directory = std::filesystem::path(path).parent_path();
+        if (directory.empty()) {
+            directory = ".";
+        }
+
+        inotify_fd = inotify_init1(IN_CLOEXEC);
+        if (inotify_fd < 0) {
+            throw ServerError::from_errno("inotify_init");
+        }
+        if (inotify_add_watch(inotify_fd, directory.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            const ServerError error =
+                ServerError::from_errno("watch " + directory);
+            close(inotify_fd);
+            throw error;
+        }
+        stop_fd = eventfd(0, EFD_CLOEXEC);
+        if (stop_fd < 0) {
+            const ServerError error = ServerError::from_errno("eventfd");
+            close(inotify_fd);
+            throw error;
+        }
+
+        thread = std::thread([this] { run(); });
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /**
+     * Stops watching (waits for a running `on_change` to finish).
+     */
+    ~FileWatcher() {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write(stop_fd, &one, sizeof(one));
+        thread.join();
+        close(stop_fd);
+        close(inotify_fd);
+    }
+
+private:
+    void run() {
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                continue;
+            }
+            if (fds[1].revents != 0) {
+                return;
+            }
+
+            const ssize_t size = read(inotify_fd, buffer, sizeof(buffer));
+            bool changed = false;
+            for (ssize_t pos = 0; pos < size;) {
+                const auto* event =
+                    reinterpret_cast<const inotify_event*>(buffer + pos);
+                if (event->len > 0 && name == event->name) {
+                    changed = true;
+                }
+                pos += sizeof(inotify_event) + event->len;
+            }
+            // several events in one read are one change
+            if (changed) {
+                on_change();
+            }
+        }
+    }
+};
+
+} // namespace server
+
+#endif
@@ -0,0 +1,696 @@
+#ifndef JSON_QUERY_SIDECAR_INDEX_HPP
+#define JSON_QUERY_SIDECAR_INDEX_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../json/json.hpp"
+#include "../selectors/selectors.hpp"
+
+// Sidecar path index (`<file>.jqi`): byte ranges of the members of the
+// top-level container (and optionally of deeper levels) of a json file, so
+// queries can parse just the part of the file they need.
+//
+// Layout (integers in the byte order of the machine that wrote it, positions
+// are offsets from the start of the index file):
+//
+// - header: magic "JQIDX001", u32 0x01020304 (byte order check), u32 depth,
+//   u64 size and i64 mtime (nanoseconds) of the json file, u64 offset of the
+//   root table (0 if the root is not an array or object)
+// - tables, every child before its parent:
+//   - array: u64 5, u64 count, count x (u64 begin, u64 end, u64 child table)
+//   - object: u64 6, u64 count, count x (u64 key offset, u64 key length,
+//     u64 begin, u64 end, u64 child table) sorted by key (keys with the same
+//     name in the original order), then the keys
+//
+// `begin` and `end` are the byte range of the value in the json file and the
+// child table is 0 if the value has none (not a container or too deep).
+namespace sidecar {
+
+/**
+ * The index can't be built or read.
+ */
+class IndexError : public std::exception {
+    std::string what_;
+
+public:
+    IndexError(const std::string& message) : what_(message) {}
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+/**
+ * A read from the index is outside of it or finds something that can't be
+ * there (an unknown table type, a byte range outside of the json file, ...).
+ * Never leaves sidecar::apply, which answers the query without the index
+ * then.
+ */
+class DamagedIndex : public std::exception {
+public:
+    const char* what() const noexcept override { return "damaged index"; }
+};
+
+constexpr char MAGIC[8] = {'J', 'Q', 'I', 'D', 'X', '0', '0', '1'};
+constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr std::size_t HEADER_SIZE = 48;
+constexpr std::uint64_t TABLE_ARRAY = 5;
+constexpr std::uint64_t TABLE_OBJECT = 6;
+
+/**
+ * Name of the index file for a json file.
+ */
+std::string index_path(const std::string& file) { return file + ".jqi"; }
+
+/**
+ * Size and modification time of a file (the index is only valid for the
+ * exact same version of the json file).
+ */
+struct FileVersion {
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+
+    bool operator==(const FileVersion&) const = default;
+};
+
+/**
+ * @throws IndexError if the file does not exist
+ */
+FileVersion file_version(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) < 0) {
+        throw IndexError("can't stat " + path);
+    }
+    return FileVersion{
+        static_cast<std::uint64_t>(info.st_size),
+        static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+            info.st_mtim.tv_nsec};
+}
+
+namespace detail {
+
+struct Entry {
+    std::string key;
+    std::uint64_t begin;
+    std::uint64_t end;
+    // index into Builder::tables or -1
+    std::int64_t child = -1;
+};
+
+struct Table {
+    bool object;
+    std::vector<Entry> entries;
+};
+
+/**
+ * Finds the byte ranges of the values in one pass over the json without
+ * building a DOM. Only checks the structure as far as needed to find the
+ * ranges, the parser reports everything else when the ranges are parsed.
+ */
+class Builder {
+    std::streambuf* buf;
+    std::uint64_t pos = 0;
+    std::size_t depth;
+
+    static constexpr int eof = std::char_traits<char>::eof();
+
+    int peek() { return buf->sgetc(); }
+
+    int get() {
+        const int c = buf->sbumpc();
+        if (c != eof) {
+            ++pos;
+        }
+        return c;
+    }
+
+    [[noreturn]] void fail(const char* expected) {
+        throw IndexError(std::string("invalid json at byte ") +
+                         std::to_string(pos) + ": expected " + expected);
+    }
+
+    void expect(char c) {
+        if (get() != c) {
+            fail(std::string(1, c).c_str());
+        }
+    }
+
+    void skip_whitespace() {
+        int c;
+        while ((c = peek()) == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            get();
+        }
+    }
+
+    // after the opening quote, returns the raw content
+    std::string read_string() {
+        std::string s;
+        int c;
+        while ((c = get()) != '"') {
+            if (c == eof) {
+                fail("\"");
+            }
+            s.push_back(static_cast<char>(c));
+            if (c == '\\') {
+                const int escaped = get();
+                if (escaped == eof) {
+                    fail("\"");
+                }
+                s.push_back(static_cast<char>(escaped));
+            }
+        }
+        return s;
+    }
+
+    void skip_string() {
+        int c;
+        while ((c = get()) != '"') {
+            if (c == eof) {
+                fail("\"");
+            }
+            if (c == '\\') {
+                get();
+            }
+        }
+    }
+
+    // skips a container that is not indexed (iteratively, so deep nesting
+    // doesn't matter)
+    void skip_container() {
+        std::size_t open = 0;
+        do {
+            const int c = get();
+            if (c == eof) {
+                fail("end of array or object");
+            } else if (c == '"') {
+                skip_string();
+            } else if (c == '{' || c == '[') {
+                ++open;
+            } else if (c == '}' || c == ']') {
+                --open;
+            }
+        } while (open > 0);
+    }
+
+    // parses the value starting at the current position and returns its
+    // table (or -1)
+    std::int64_t value(std::size_t level) {
+        const int c = peek();
+        if ((c == '{' || c == '[') && level < depth) {
+            return container(level);
+        } else if (c == '{' || c == '[') {
+            skip_container();
+        } else if (c == '"') {
+            get();
+            skip_string();
+        } else {
+            // number or literal
+            int next;
+            while ((next = peek()) != eof && next != ',' && next != ']' &&
+                   next != '}' && next != ' ' && next != '\t' &&
+                   next != '\n' && next != '\r') {
+                get();
+            }
+        }
+        return -1;
+    }
+
+    std::int64_t container(std::size_t level) {
+        const bool object = get() == '{';
+        const char close = object ? '}' : ']';
+        Table table{object, {}};
+
+        skip_whitespace();
+        if (peek() == close) {
+            get();
+        } else {
+            while (true) {
+                skip_whitespace();
+                Entry entry;
+                if (object) {
+                    expect('"');
+                    entry.key = read_string();
+                    skip_whitespace();
+                    expect(':');
+                    skip_whitespace();
+                }
+                entry.begin = pos;
+                entry.child = value(level + 1);
+                entry.end = pos;
+                table.entries.push_back(std::move(entry));
+
+                skip_whitespace();
+                const int c = get();
+                if (c == close) {
+                    break;
+                } else if (c != ',') {
+                    fail(object ? ", or }" : ", or ]");
+                }
+            }
+        }
+
+        tables.push_back(std::move(table));
+        return tables.size() - 1;
+    }
+
+public:
+    std::vector<Table> tables;
+
+    Builder(std::istream& in, std::size_t depth)
+        : buf(in.rdbuf()), depth(depth) {}
+
+    /**
+     * Returns the root table (or -1).
+     */
+    std::int64_t build() {
+        skip_whitespace();
+        return value(0);
+    }
+};
+
+/**
+ * Writes the tables after the header, children first.
+ */
+class Writer {
+    std::ostream& out;
+    std::vector<Table>& tables;
+    std::uint64_t pos = HEADER_SIZE;
+
+    void put(std::uint64_t value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        pos += sizeof(value);
+    }
+
+public:
+    Writer(std::ostream& out, std::vector<Table>& tables)
+        : out(out), tables(tables) {}
+
+    std::uint64_t write(std::int64_t index) {
+        Table& table = tables[index];
+        std::vector<std::uint64_t> children;
+        children.reserve(table.entries.size());
+        for (const Entry& entry : table.entries) {
+            children.push_back(entry.child < 0 ? 0 : write(entry.child));
+        }
+
+        std::vector<std::size_t> order(table.entries.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        if (table.object) {
+            std::stable_sort(order.begin(), order.end(),
+                             [&table](std::size_t a, std::size_t b) {
+                                 return table.entries[a].key <
+                                        table.entries[b].key;
+                             });
+        }
+
+        const std::uint64_t start = pos;
+        const std::size_t entry_size = table.object ? 40 : 24;
+        std::uint64_t key_pos = start + 16 + entry_size * order.size();
+        put(table.object ? TABLE_OBJECT : TABLE_ARRAY);
+        put(order.size());
+        for (std::size_t i : order) {
+            const Entry& entry = table.entries[i];
+            if (table.object) {
+                put(key_pos);
+                put(entry.key.size());
+                key_pos += entry.key.size();
+            }
+            put(entry.begin);
+            put(entry.end);
+            put(children[i]);
+        }
+        if (table.object) {
+            for (std::size_t i : order) {
+                const std::string& key = table.entries[i].key;
+                out.write(key.data(), key.size());
+                pos += key.size();
+            }
+        }
+        // the keys are not needed anymore
+        table.entries = {};
+        return start;
+    }
+};
+
+} // namespace detail
+
+/**
+ * Builds the index of the json file `file` with `depth` levels in one pass
+ * and writes it to index_path(file). The index is written to a temporary
+ * file first and then renamed, so readers never see a partial index.
+ *
+ * @throws IndexError if the json is not valid or a file can't be accessed
+ */
+void build_index(const std::string& file, std::size_t depth) {
+    const FileVersion version = file_version(file);
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open()) {
+        throw IndexError("can't open " + file);
+    }
+    detail::Builder builder(in, depth);
+    const std::int64_t root = builder.build();
+
+    const std::string path = index_path(file);
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw IndexError("can't create " + tmp);
+        }
+        out.write(std::string(HEADER_SIZE, '\0').data(), HEADER_SIZE);
+        detail::Writer writer(out, builder.tables);
+        const std::uint64_t root_table = root < 0 ? 0 : writer.write(root);
+
+        out.seekp(0);
+        out.write(MAGIC, sizeof(MAGIC));
+        const std::uint32_t marks[2] = {BYTE_ORDER_MARK,
+                                        static_cast<std::uint32_t>(depth)};
+        out.write(reinterpret_cast<const char*>(marks), sizeof(marks));
+        const std::uint64_t fields[3] = {
+            version.size, static_cast<std::uint64_t>(version.mtime),
+            root_table};
+        out.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+        if (!out) {
+            throw IndexError("failed to write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw IndexError("can't rename " + tmp + " to " + path);
+    }
+}
+
+/**
+ * Byte range of a value in the json file and its table in the index (0 if
+ * it has none).
+ */
+struct Located {
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::uint64_t table;
+};
+
+/**
+ * A mapped index file together with the json file it belongs to.
+ */
+class Index {
+    std::string file;
+    int fd = -1;
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+    std::uint64_t root_table = 0;
+
+    void check(std::uint64_t at, std::uint64_t length) const {
+        if (at > size || length > size - at) {
+            throw DamagedIndex();
+        }
+    }
+
+    std::uint64_t read(std::uint64_t at) const {
+        check(at, sizeof(std::uint64_t));
+        std::uint64_t value;
+        std::memcpy(&value, data + at, sizeof(value));
+        return value;
+    }
+
+    std::string_view key(std::uint64_t entry) const {
+        const std::uint64_t at = read(entry);
+        const std::uint64_t length = read(entry + 8);
+        check(at, length);
+        return std::string_view(reinterpret_cast<const char*>(data + at),
+                                length);
+    }
+
+    // the byte range has to be inside the json file
+    Located located(std::uint64_t entry) const {
+        const Located value{read(entry), read(entry + 8), read(entry + 16)};
+        if (value.begin > value.end || value.end > file_size()) {
+            throw DamagedIndex();
+        }
+        return value;
+    }
+
+public:
+    /**
+     * Opens the index of `file`. Returns nothing if there is no usable index:
+     * none exists, it was built for another version of the file (size or
+     * mtime changed) or it is damaged or unreadable. The caller then parses
+     * the whole file as if there was no index.
+     *
+     * @throws IndexError if the json file itself can't be opened
+     */
+    static std::optional<Index> open(const std::string& file);
+
+    Index(const Index&) = delete;
+    Index& operator=(const Index&) = delete;
+    Index(Index&& other)
+        : file(std::move(other.file)), fd(std::exchange(other.fd, -1)),
+          data(std::exchange(other.data, nullptr)),
+          size(std::exchange(other.size, 0)), root_table(other.root_table) {}
+    Index& operator=(Index&&) = delete;
+
+    ~Index() {
+        if (data != nullptr) {
+            munmap(const_cast<std::byte*>(data), size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    /**
+     * Table of the root (0 if the root is not a container).
+     */
+    std::uint64_t root() const { return root_table; }
+
+    /*
+     * All reads from the index are bounds checked and throw DamagedIndex if
+     * they are outside of it (or find something else that can't be there).
+     */
+
+    bool is_object(std::uint64_t table) const {
+        const std::uint64_t type = read(table);
+        if (type != TABLE_OBJECT && type != TABLE_ARRAY) {
+            throw DamagedIndex();
+        }
+        return type == TABLE_OBJECT;
+    }
+
+    /**
+     * Number of entries of a table (all of them are inside the index).
+     */
+    std::uint64_t count(std::uint64_t table) const {
+        const std::uint64_t entry_size = is_object(table) ? 40 : 24;
+        const std::uint64_t entries = read(table + 8);
+        if (entries > (size - table - 16) / entry_size) {
+            throw DamagedIndex();
+        }
+        return entries;
+    }
+
+    /**
+     * Item `i` of an array table (`i` has to be smaller than count()).
+     */
+    Located item(std::uint64_t table, std::size_t i) const {
+        return located(table + 16 + 24 * i);
+    }
+
+    /**
+     * First member with the key `name` of an object table (binary search).
+     */
+    std::optional<Located> member(std::uint64_t table,
+                                  std::string_view name) const {
+        const std::uint64_t entries = table + 16;
+        std::size_t low = 0;
+        std::size_t high = count(table);
+        while (low < high) {
+            const std::size_t mid = low + (high - low) / 2;
+            if (key(entries + 40 * mid) < name) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        if (low == count(table) || key(entries + 40 * low) != name) {
+            return std::nullopt;
+        }
+        return located(entries + 40 * low + 16);
+    }
+
+    /**
+     * Parses the given byte range of the json file.
+     *
+     * @throws IndexError if the file can't be read
+     * @throws DamagedIndex if the range is not inside the file or not json
+     */
+    json::JsonNode parse(std::uint64_t begin, std::uint64_t end) const {
+        if (begin > end || end > file_size()) {
+            throw DamagedIndex();
+        }
+        std::string content(end - begin, '\0');
+        std::size_t done = 0;
+        while (done < content.size()) {
+            const ssize_t got = pread(fd, content.data() + done,
+                                      content.size() - done, begin + done);
+            if (got <= 0) {
+                throw IndexError("can't read " + file);
+            }
+            done += got;
+        }
+        try {
+            return json::parse_json(content);
+        } catch (const json::SyntaxError&) {
+            // the ranges of an intact index are always valid json on their
+            // own (if the file is not, parsing all of it reports the error)
+            throw DamagedIndex();
+        } catch (const json::FailedToParseJsonException&) {
+            throw DamagedIndex();
+        }
+    }
+
+    /**
+     * Size of the json file.
+     */
+    std::uint64_t file_size() const { return read(16); }
+
+private:
+    Index(std::string file) : file(std::move(file)) {}
+};
+
+std::optional<Index> Index::open(const std::string& file) {
+    const std::string path = index_path(file);
+    const int index_fd = ::open(path.c_str(), O_RDONLY);
+    if (index_fd < 0) {
+        return std::nullopt;
+    }
+    struct stat info;
+    if (fstat(index_fd, &info) < 0 ||
+        info.st_size < std::ptrdiff_t(HEADER_SIZE)) {
+        close(index_fd);
+        return std::nullopt;
+    }
+
+    Index index(file);
+    index.size = info.st_size;
+    void* p = mmap(nullptr, index.size, PROT_READ, MAP_PRIVATE, index_fd, 0);
+    close(index_fd);
+    if (p == MAP_FAILED) {
+        return std::nullopt;
+    }
+    index.data = static_cast<const std::byte*>(p);
+
+    std::uint32_t byte_order;
+    std::memcpy(&byte_order, index.data + 8, sizeof(byte_order));
+    if (std::memcmp(index.data, MAGIC, sizeof(MAGIC)) != 0 ||
+        byte_order != BYTE_ORDER_MARK) {
+        // damaged (or written on a machine with another byte order)
+        return std::nullopt;
+    }
+    const FileVersion indexed{index.read(16),
+                              static_cast<std::int64_t>(index.read(24))};
+    if (!(file_version(file) == indexed)) {
+        return std::nullopt;
+    }
+    index.root_table = index.read(32);
+    if (index.root_table >= index.size) {
+        return std::nullopt;
+    }
+
+    index.fd = ::open(file.c_str(), O_RDONLY);
+    if (index.fd < 0) {
+        throw IndexError("can't open " + file);
+    }
+    return index;
+}
+
+/**
+ * Applies a selector chain with the help of the index.
+ *
+ * The leading key and index selectors are looked up in the index as far as
+ * it goes. Only the byte range of the value found that way is parsed and the
+ * rest of the chain is applied to it. Without any leading key or index
+ * selectors this parses the whole file.
+ *
+ * @throws DamagedIndex if the index is damaged
+ */
+selectors::ApplyResult try_apply(const selectors::RootSelector& selector,
+                                 const Index& index,
+                                 const selectors::ApplyContext& ctx) {
+    using namespace selectors;
+    Located current{0, index.file_size(), index.root()};
+    auto it = selector.get().cbegin();
+    const auto end = selector.get().cend();
+    for (; it != end && current.table != 0; ++it) {
+        const std::uint64_t table = current.table;
+        if (it->inner.type() == typeid(AnyRootSelector)) {
+            continue;
+        }
+        if (it->inner.type() == typeid(KeySelector)) {
+            const KeySelector& key = it->as<KeySelector>();
+            if (!index.is_object(table)) {
+                return Unexpected(ApplyError::mismatch(
+                    KeySelector::name(), json::JsonArray::name()));
+            }
+            std::optional<Located> value = index.member(table, key.get());
+            if (!value) {
+                return Unexpected(ApplyError::key_not_found(key.get()));
+            }
+            current = *value;
+        } else if (it->inner.type() == typeid(IndexSelector)) {
+            const int i = it->as<IndexSelector>().get();
+            if (index.is_object(table)) {
+                return Unexpected(ApplyError::mismatch(
+                    IndexSelector::name(), json::JsonObject::name()));
+            }
+            if (i < 0 || static_cast<std::size_t>(i) >= index.count(table)) {
+                return Unexpected(ApplyError::index_out_of_range(i));
+            }
+            current = index.item(table, i);
+        } else {
+            break;
+        }
+    }
+    return apply_selector(index.parse(current.begin, current.end), it, end,
+                          ctx);
+}
+
+/**
+ * Same as Selectors::apply but with the help of the index (see try_apply).
+ * Returns nothing if the index turns out to be damaged, the caller then
+ * parses the whole file as if there was no index.
+ *
+ * Throws ApplySelectorError if one of the selectors can't be applied.
+ */
+std::optional<json::JsonNode> apply(const selectors::Selectors& selectors,
+                                    const Index& index,
+                                    const selectors::ApplyContext& ctx) {
+    try {
+        return selectors.apply_each(
+            ctx, [&index, &ctx](const selectors::RootSelector& selector) {
+                return try_apply(selector, index, ctx);
+            });
+    } catch (const DamagedIndex&) {
+        return std::nullopt;
+    }
+}
+
+} // namespace sidecar
+
+#endif
@@ -0,0 +1,499 @@
+#ifndef JSON_QUERY_SNAPSHOT_SNAPSHOT_HPP
+#define JSON_QUERY_SNAPSHOT_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../json/json.hpp"
+#include "../selectors/selectors.hpp"
+
+// Binary snapshot of a parsed document (`.jqs` files).
+//
+// Layout (integers in the byte order of the machine that wrote it, all
+// positions are offsets from the start of the file so the file can be mapped
+// anywhere):
+//
+// - header: magic "JQSNAP01", u32 0x01020304 (byte order check), u32 0,
+//   u64 offset of the root node, u64 size of the file
+// - nodes, every child before its parent:
+//   - null, true, false: tag byte
+//   - string, number: tag, u32 length, the characters
+//   - array: tag, u32 count, count x u64 offset of the item
+//   - object: tag, u32 count, count x (u64 offset of the key (a string
+//     node), u64 offset of the value) in the original order, count x u32
+//     index of the members sorted by key (for binary search)
+namespace snapshot {
+
+/**
+ * The file is not a (valid) snapshot.
+ */
+class SnapshotError : public std::exception {
+    std::string what_;
+
+public:
+    SnapshotError(const std::string& message) : what_(message) {}
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+constexpr char MAGIC[8] = {'J', 'Q', 'S', 'N', 'A', 'P', '0', '1'};
+constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr std::size_t HEADER_SIZE = 32;
+
+enum Tag : std::uint8_t {
+    TAG_NULL = 0,
+    TAG_TRUE = 1,
+    TAG_FALSE = 2,
+    TAG_STRING = 3,
+    TAG_NUMBER = 4,
+    TAG_ARRAY = 5,
+    TAG_OBJECT = 6
+};
+
+namespace detail {
+
+/**
+ * Writes nodes and remembers where they start.
+ */
+class Writer {
+    std::ostream& out;
+    std::uint64_t pos = HEADER_SIZE;
+
+public:
+    explicit Writer(std::ostream& out) : out(out) {}
+
+    std::uint64_t position() const { return pos; }
+
+    template <typename T> void put(T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        pos += sizeof(value);
+    }
+
+    void put_bytes(std::string_view bytes) {
+        out.write(bytes.data(), bytes.size());
+        pos += bytes.size();
+    }
+
+    std::uint64_t write_string(Tag tag, const std::string& value) {
+        if (value.size() > UINT32_MAX) {
+            throw SnapshotError("string too long for a snapshot");
+        }
+        const std::uint64_t start = pos;
+        put(static_cast<std::uint8_t>(tag));
+        put(static_cast<std::uint32_t>(value.size()));
+        put_bytes(value);
+        return start;
+    }
+
+    std::uint64_t write(const json::JsonNode& json) {
+        return json.apply_visitor(overloaded{
+            [this](const json::JsonLiteral& literal) {
+                const std::uint64_t start = pos;
+                switch (literal.get()) {
+                case json::JSON_NULL:
+                    put(static_cast<std::uint8_t>(TAG_NULL));
+                    break;
+                case json::JSON_TRUE:
+                    put(static_cast<std::uint8_t>(TAG_TRUE));
+                    break;
+                case json::JSON_FALSE:
+                    put(static_cast<std::uint8_t>(TAG_FALSE));
+                    break;
+                }
+                return start;
+            },
+            [this](const json::JsonString& string) {
+                return write_string(TAG_STRING, string.get());
+            },
+            [this](const json::JsonNumber& number) {
+                return write_string(TAG_NUMBER, number.get());
+            },
+            [this](const json::JsonArray& array) {
+                std::vector<std::uint64_t> items;
+                items.reserve(array.get().size());
+                for (const json::JsonNode& item : array.get()) {
+                    items.push_back(write(item));
+                }
+                const std::uint64_t start = pos;
+                put(static_cast<std::uint8_t>(TAG_ARRAY));
+                put(static_cast<std::uint32_t>(items.size()));
+                for (std::uint64_t item : items) {
+                    put(item);
+                }
+                return start;
+            },
+            [this](const json::JsonObject& object) {
+                const std::vector<std::string>& keys = object.keys();
+                std::vector<std::pair<std::uint64_t, std::uint64_t>> members;
+                members.reserve(keys.size());
+                for (const std::string& key : keys) {
+                    const std::uint64_t value = write(object.at(key));
+                    members.emplace_back(write_string(TAG_STRING, key), value);
+                }
+                std::vector<std::uint32_t> sorted(keys.size());
+                std::iota(sorted.begin(), sorted.end(), 0);
+                std::sort(sorted.begin(), sorted.end(),
+                          [&keys](std::uint32_t a, std::uint32_t b) {
+                              return keys[a] < keys[b];
+                          });
+
+                const std::uint64_t start = pos;
+                put(static_cast<std::uint8_t>(TAG_OBJECT));
+                put(static_cast<std::uint32_t>(members.size()));
+                for (auto [key, value] : members) {
+                    put(key);
+                    put(value);
+                }
+                for (std::uint32_t index : sorted) {
+                    put(index);
+                }
+                return start;
+            }});
+    }
+};
+
+} // namespace detail
+
+/**
+ * Writes the snapshot of `json` to `out` (which has to be opened in binary
+ * mode and positioned at the start).
+ */
+void write_snapshot(const json::JsonNode& json, std::ostream& out) {
+    // header is written at the end when the root is known
+    out.write(std::string(HEADER_SIZE, '\0').data(), HEADER_SIZE);
+    detail::Writer writer(out);
+    const std::uint64_t root = writer.write(json);
+    const std::uint64_t size = writer.position();
+
+    out.seekp(0);
+    out.write(MAGIC, sizeof(MAGIC));
+    const std::uint32_t header[2] = {BYTE_ORDER_MARK, 0};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    const std::uint64_t offsets[2] = {root, size};
+    out.write(reinterpret_cast<const char*>(offsets), sizeof(offsets));
+    out.seekp(0, std::ios::end);
+    if (!out) {
+        throw SnapshotError("failed to write snapshot");
+    }
+}
+
+/**
+ * Reference to a node inside a mapped snapshot. Only valid as long as the
+ * Snapshot exists. Cheap to copy.
+ *
+ * Every read is checked against the size of the mapping, so a truncated or
+ * corrupted file throws SnapshotError instead of reading out of bounds.
+ */
+class NodeRef {
+    const std::byte* data;
+    std::uint64_t data_size;
+    std::uint64_t offset;
+
+    /**
+     * @throws SnapshotError if `length` bytes at `at` are not in the mapping
+     */
+    void check(std::uint64_t at, std::uint64_t length) const {
+        if (at > data_size || length > data_size - at) {
+            throw SnapshotError("corrupt snapshot");
+        }
+    }
+
+    template <typename T> T read(std::uint64_t at) const {
+        check(at, sizeof(T));
+        T value;
+        std::memcpy(&value, data + at, sizeof(T));
+        return value;
+    }
+
+    /**
+     * Node whose offset is stored at `at`.
+     */
+    NodeRef child(std::uint64_t at) const {
+        const std::uint64_t child_offset = read<std::uint64_t>(at);
+        // children are written before their parents, this also rules out
+        // cycles
+        if (child_offset >= offset) {
+            throw SnapshotError("corrupt snapshot");
+        }
+        return NodeRef(data, data_size, child_offset);
+    }
+
+    std::uint64_t entries() const { return offset + 1 + sizeof(std::uint32_t); }
+
+public:
+    /**
+     * @throws SnapshotError if `offset` is not in the mapping
+     */
+    NodeRef(const std::byte* data, std::uint64_t data_size,
+            std::uint64_t offset)
+        : data(data), data_size(data_size), offset(offset) {
+        check(offset, 1);
+    }
+
+    Tag tag() const { return static_cast<Tag>(data[offset]); }
+
+    /**
+     * Same as JsonNode::name().
+     */
+    const char* name() const {
+        switch (tag()) {
+        case TAG_STRING:
+            return json::JsonString::name();
+        case TAG_NUMBER:
+            return json::JsonNumber::name();
+        case TAG_ARRAY:
+            return json::JsonArray::name();
+        case TAG_OBJECT:
+            return json::JsonObject::name();
+        default:
+            return json::JsonLiteral::name();
+        }
+    }
+
+    /**
+     * Characters of a string or number.
+     */
+    std::string_view text() const {
+        const std::uint32_t length = read<std::uint32_t>(offset + 1);
+        check(entries(), length);
+        return std::string_view(
+            reinterpret_cast<const char*>(data + entries()), length);
+    }
+
+    /**
+     * Number of items of an array or members of an object.
+     */
+    std::size_t size() const { return read<std::uint32_t>(offset + 1); }
+
+    /**
+     * Item of an array (`index` has to be smaller than size()).
+     */
+    NodeRef item(std::size_t index) const {
+        return child(entries() + 8 * index);
+    }
+
+    /**
+     * Key and value of the member of an object in the original order.
+     */
+    std::pair<NodeRef, NodeRef> member(std::size_t index) const {
+        const std::uint64_t at = entries() + 16 * index;
+        return {child(at), child(at + 8)};
+    }
+
+    /**
+     * Value of the member of an object with the given key (binary search).
+     */
+    std::optional<NodeRef> find(std::string_view key) const {
+        const std::size_t count = size();
+        const std::uint64_t sorted = entries() + 16 * count;
+        std::size_t low = 0;
+        std::size_t high = count;
+        while (low < high) {
+            const std::size_t mid = low + (high - low) / 2;
+            const std::uint32_t index = read<std::uint32_t>(sorted + 4 * mid);
+            if (index >= count) {
+                throw SnapshotError("corrupt snapshot");
+            }
+            const auto [member_key, value] = member(index);
+            const int cmp = member_key.text().compare(key);
+            if (cmp == 0) {
+                return value;
+            } else if (cmp < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Builds the normal DOM for this node and everything below it.
+     */
+    json::JsonNode decode() const {
+        switch (tag()) {
+        case TAG_NULL:
+            return json::JsonNode(json::JsonLiteral(json::JSON_NULL));
+        case TAG_TRUE:
+            return json::JsonNode(json::JsonLiteral(json::JSON_TRUE));
+        case TAG_FALSE:
+            return json::JsonNode(json::JsonLiteral(json::JSON_FALSE));
+        case TAG_STRING:
+            return json::JsonNode(json::JsonString(std::string(text())));
+        case TAG_NUMBER:
+            return json::JsonNode(json::JsonNumber(std::string(text())));
+        case TAG_ARRAY: {
+            // before the reserve so a corrupt count can't allocate too much
+            check(entries(), 8 * std::uint64_t{size()});
+            std::vector<json::JsonNode> items;
+            items.reserve(size());
+            for (std::size_t i = 0; i < size(); ++i) {
+                items.push_back(item(i).decode());
+            }
+            return json::JsonNode(json::JsonArray(std::move(items)));
+        }
+        case TAG_OBJECT: {
+            check(entries(), 20 * std::uint64_t{size()});
+            std::vector<std::pair<std::string, json::JsonNode>> members;
+            members.reserve(size());
+            for (std::size_t i = 0; i < size(); ++i) {
+                const auto [key, value] = member(i);
+                members.emplace_back(std::string(key.text()), value.decode());
+            }
+            return json::JsonNode(json::JsonObject(members));
+        }
+        }
+        throw SnapshotError("corrupt snapshot");
+    }
+};
+
+/**
+ * A snapshot file mapped into memory.
+ *
+ * Opening it only maps the file, nothing is read or parsed until nodes are
+ * accessed (and then the OS only loads the pages that are touched).
+ */
+class Snapshot {
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+    std::uint64_t root_offset = 0;
+
+public:
+    /**
+     * @throws SnapshotError if the file can't be mapped or is no snapshot
+     */
+    explicit Snapshot(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw SnapshotError("can't open snapshot " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) < 0 ||
+            info.st_size < std::ptrdiff_t(HEADER_SIZE)) {
+            close(fd);
+            throw SnapshotError(path + " is not a snapshot");
+        }
+        size = info.st_size;
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            throw SnapshotError("can't map snapshot " + path);
+        }
+        data = static_cast<const std::byte*>(p);
+
+        std::uint32_t byte_order;
+        std::uint64_t file_size;
+        std::memcpy(&byte_order, data + 8, sizeof(byte_order));
+        std::memcpy(&root_offset, data + 16, sizeof(root_offset));
+        std::memcpy(&file_size, data + 24, sizeof(file_size));
+        if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+            byte_order != BYTE_ORDER_MARK || file_size != size ||
+            root_offset >= size) {
+            munmap(const_cast<std::byte*>(data), size);
+            throw SnapshotError(path + " is not a snapshot (or was written "
+                                       "on a machine with another byte "
+                                       "order)");
+        }
+    }
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    ~Snapshot() { munmap(const_cast<std::byte*>(data), size); }
+
+    /**
+     * @throws SnapshotError if the root is outside of the file
+     */
+    NodeRef root() const { return NodeRef(data, size, root_offset); }
+};
+
+/**
+ * Returns true if the file starts like a snapshot.
+ */
+bool is_snapshot(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return ifs.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+/**
+ * Applies a selector chain to a snapshot.
+ *
+ * The leading key and index selectors are followed directly in the snapshot
+ * (binary search in objects, direct indexing in arrays) without building any
+ * DOM. Only the node they lead to is decoded and the rest of the chain is
+ * applied to that like usual. So e.g. `"a"."b"[3]` on a huge document only
+ * touches the few pages on the path.
+ */
+selectors::ApplyResult try_apply(const selectors::RootSelector& selector,
+                                 NodeRef node,
+                                 const selectors::ApplyContext& ctx) {
+    using namespace selectors;
+    auto it = selector.get().cbegin();
+    const auto end = selector.get().cend();
+    for (; it != end; ++it) {
+        if (it->inner.type() == typeid(AnyRootSelector)) {
+            continue;
+        }
+        if (it->inner.type() == typeid(KeySelector)) {
+            const KeySelector& key = it->as<KeySelector>();
+            if (node.tag() != TAG_OBJECT) {
+                return Unexpected(
+                    ApplyError::mismatch(KeySelector::name(), node.name()));
+            }
+            std::optional<NodeRef> value = node.find(key.get());
+            if (!value) {
+                return Unexpected(ApplyError::key_not_found(key.get()));
+            }
+            node = *value;
+        } else if (it->inner.type() == typeid(IndexSelector)) {
+            const int index = it->as<IndexSelector>().get();
+            if (node.tag() != TAG_ARRAY) {
+                return Unexpected(
+                    ApplyError::mismatch(IndexSelector::name(), node.name()));
+            }
+            if (index < 0 || static_cast<std::size_t>(index) >= node.size()) {
+                return Unexpected(ApplyError::index_out_of_range(index));
+            }
+            node = node.item(index);
+        } else {
+            break;
+        }
+    }
+    return apply_selector(node.decode(), it, end, ctx);
+}
+
+/**
+ * Same as Selectors::apply but on a snapshot (see try_apply).
+ *
+ * Throws ApplySelectorError if one of the selectors can't be applied.
+ */
+json::JsonNode apply(const selectors::Selectors& selectors,
+                     const Snapshot& snapshot,
+                     const selectors::ApplyContext& ctx) {
+    return selectors.apply_each(
+        ctx, [&snapshot, &ctx](const selectors::RootSelector& selector) {
+            return try_apply(selector, snapshot.root(), ctx);
+        });
+}
+
+} // namespace snapshot
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef JSON_QUERY_STATS_STATS_HPP
+#define JSON_QUERY_STATS_STATS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "../counters/counters.hpp"
+#include "../json/json.hpp"
+#include "../trace/trace.hpp"
+
+// The report of --stats: where the time of a query goes and how much data
+// and memory it touches.
+namespace stats {
+
+/**
+ * Number of json values by type.
+ */
+struct NodeCounts {
+    std::size_t objects = 0;
+    std::size_t arrays = 0;
+    std::size_t strings = 0;
+    std::size_t numbers = 0;
+    std::size_t literals = 0;
+
+    std::size_t total() const {
+        return objects + arrays + strings + numbers + literals;
+    }
+};
+
+/**
+ * Counts all values in the json (iteratively, so deep nesting doesn't
+ * matter).
+ */
+NodeCounts count_nodes(const json::JsonNode& root) {
+    NodeCounts counts;
+    std::vector<const json::JsonNode*> todo{&root};
+    while (!todo.empty()) {
+        const json::JsonNode* node = todo.back();
+        todo.pop_back();
+        node->apply_visitor([&counts, &todo](const auto& item) {
+            using T = std::decay_t<decltype(item)>;
+            if constexpr (std::is_same_v<T, json::JsonObject>) {
+                counts.objects++;
+                for (const std::string& key : item.keys()) {
+                    todo.push_back(&item.at(key));
+                }
+            } else if constexpr (std::is_same_v<T, json::JsonArray>) {
+                counts.arrays++;
+                for (const json::JsonNode& child : item.get()) {
+                    todo.push_back(&child);
+                }
+            } else if constexpr (std::is_same_v<T, json::JsonString>) {
+                counts.strings++;
+            } else if constexpr (std::is_same_v<T, json::JsonNumber>) {
+                counts.numbers++;
+            } else {
+                counts.literals++;
+            }
+        });
+    }
+    return counts;
+}
+
+/**
+ * Largest resident set size of the process so far in bytes.
+ */
+std::size_t peak_rss() {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0;
+    }
+    // linux reports KiB
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+}
+
+/**
+ * Stream buffer that counts the bytes written through it to another one.
+ */
+class CountingBuffer : public std::streambuf {
+    std::streambuf* target;
+    std::size_t count = 0;
+
+public:
+    explicit CountingBuffer(std::streambuf* target) : target(target) {}
+
+    std::size_t get_count() const { return count; }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        count++;
+        return target->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        const std::streamsize written = target->sputn(s, n);
+        count += written;
+        return written;
+    }
+
+    int sync() override { return target->pubsync(); }
+};
+
+/**
+ * Measurements of one query. Phases are timed with time() in the order they
+ * run, everything else is filled in by the caller (the counts are optional
+ * because not every way of querying has e.g. a DOM of the whole input).
+ */
+class Report {
+    struct Phase {
+        std::string name;
+        double seconds;
+    };
+
+    std::vector<Phase> phases;
+
+public:
+    std::optional<std::size_t> input_bytes;
+    std::optional<NodeCounts> input_nodes;
+    std::optional<std::size_t> output_bytes;
+    std::optional<NodeCounts> output_nodes;
+    std::optional<std::size_t> allocations;
+    // only with a counting counters policy (`make COUNTERS=1`)
+    std::optional<counters::Values> events;
+    std::size_t peak_rss = 0;
+
+    /**
+     * Runs `f` and records its wall time as phase `name` (and as a span of
+     * the trace).
+     */
+    template <typename F> decltype(auto) time(const char* name, F&& f) {
+        trace::Span span(name);
+        const auto start = std::chrono::steady_clock::now();
+        struct Record {
+            Report& report;
+            const char* name;
+            std::chrono::steady_clock::time_point start;
+            // also records phases that throw
+            ~Record() {
+                report.phases.push_back(
+                    {name,
+                     std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()});
+            }
+        } record{*this, name, start};
+        return f();
+    }
+
+    double seconds(const std::string& name) const {
+        for (const Phase& phase : phases) {
+            if (phase.name == name) {
+                return phase.seconds;
+            }
+        }
+        return 0;
+    }
+
+    double total_seconds() const {
+        double total = 0;
+        for (const Phase& phase : phases) {
+            total += phase.seconds;
+        }
+        return total;
+    }
+
+    /**
+     * Human readable report (for the terminal).
+     */
+    void print(std::ostream& o) const {
+        o << "=== STATS ===" << std::endl;
+        for (const Phase& phase : phases) {
+            o << phase.name << ": " << phase.seconds * 1000 << " ms"
+              << std::endl;
+        }
+        o << "total: " << total_seconds() * 1000 << " ms" << std::endl;
+        if (input_bytes) {
+            o << "input: " << *input_bytes << " bytes";
+            if (seconds("parse_json") > 0) {
+                o << ", " << megabytes_per_second(seconds("parse_json"))
+                  << " MB/s parsing";
+            }
+            o << ", " << megabytes_per_second(total_seconds())
+              << " MB/s total" << std::endl;
+        }
+        if (input_nodes) {
+            o << "input nodes: ";
+            print_nodes(o, *input_nodes);
+        }
+        if (output_bytes) {
+            o << "output: " << *output_bytes << " bytes" << std::endl;
+        }
+        if (output_nodes) {
+            o << "output nodes: ";
+            print_nodes(o, *output_nodes);
+        }
+        if (allocations) {
+            o << "allocations: " << *allocations << std::endl;
+        }
+        if (events) {
+            o << "counters:" << std::endl;
+            for (std::size_t i = 0; i < events->size(); ++i) {
+                o << "  " << counters::NAMES[i] << ": " << (*events)[i]
+                  << std::endl;
+            }
+        }
+        o << "peak RSS: " << peak_rss << " bytes" << std::endl;
+    }
+
+    /**
+     * The same as a single line json object (for monitoring). Times are in
+     * seconds, values that weren't measured are missing.
+     */
+    void print_json(std::ostream& o) const {
+        // the stream is usually std::cerr, leave its precision as it was
+        const std::streamsize precision = o.precision(9);
+        o << "{\"phases\":{";
+        const char* sep = "";
+        for (const Phase& phase : phases) {
+            o << sep << "\"" << phase.name << "\":" << phase.seconds;
+            sep = ",";
+        }
+        o << "},\"total_seconds\":" << total_seconds();
+        if (input_bytes) {
+            o << ",\"input_bytes\":" << *input_bytes
+              << ",\"parse_megabytes_per_second\":"
+              << megabytes_per_second(seconds("parse_json"))
+              << ",\"megabytes_per_second\":"
+              << megabytes_per_second(total_seconds());
+        }
+        if (input_nodes) {
+            o << ",\"input_nodes\":";
+            print_nodes_json(o, *input_nodes);
+        }
+        if (output_bytes) {
+            o << ",\"output_bytes\":" << *output_bytes;
+        }
+        if (output_nodes) {
+            o << ",\"output_nodes\":";
+            print_nodes_json(o, *output_nodes);
+        }
+        if (allocations) {
+            o << ",\"allocations\":" << *allocations;
+        }
+        if (events) {
+            o << ",\"counters\":{";
+            for (std::size_t i = 0; i < events->size(); ++i) {
+                o << (i == 0 ? "" : ",") << "\"" << counters::NAMES[i]
+                  << "\":" << (*events)[i];
+            }
+            o << "}";
+        }
+        o << ",\"peak_rss_bytes\":" << peak_rss << "}" << std::endl;
+        o.precision(precision);
+    }
+
+private:
+    double megabytes_per_second(double seconds) const {
+        if (!input_bytes || seconds <= 0) {
+            return 0;
+        }
+        return *input_bytes / seconds / 1e6;
+    }
+
+    static void print_nodes(std::ostream& o, const NodeCounts& counts) {
+        o << counts.total() << " (" << counts.objects << " objects, "
+          << counts.arrays << " arrays, " << counts.strings << " strings, "
+          << counts.numbers << " numbers, " << counts.literals
+          << " literals)" << std::endl;
+    }
+
+    static void print_nodes_json(std::ostream& o, const NodeCounts& counts) {
+        o << "{\"objects\":" << counts.objects
+          << ",\"arrays\":" << counts.arrays
+          << ",\"strings\":" << counts.strings
+          << ",\"numbers\":" << counts.numbers
+          << ",\"literals\":" << counts.literals
+          << ",\"total\":" << counts.total() << "}";
+    }
+};
+
+} // namespace stats
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef JSON_QUERY_STREAM_FILES_HPP
+#define JSON_QUERY_STREAM_FILES_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../errors.hpp"
+#include "../parallel/thread_pool.hpp"
+#include "../selectors/selectors.hpp"
+#include "../trace/trace.hpp"
+#include "lines.hpp"
+
+namespace stream {
+
+/**
+ * Settings for process_files.
+ */
+struct FilesOptions {
+    // prefix every result (and error) with the name of the file
+    bool with_filename = false;
+    // maximum number of files that are being processed or waiting to be
+    // written, 0 means 2 per thread
+    std::size_t max_in_flight = 0;
+    // number of files ahead of the ones being processed that the OS is asked
+    // to start reading
+    std::size_t prefetch = 4;
+};
+
+/**
+ * Summary of process_files.
+ */
+struct FilesResult {
+    std::size_t processed = 0;
+    std::size_t failed = 0;
+};
+
+/**
+ * Reads a list of file names, one per line. Empty lines are skipped.
+ */
+std::vector<std::string> read_file_list(std::istream& in) {
+    std::vector<std::string> files;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            files.push_back(line);
+        }
+    }
+    return files;
+}
+
+/**
+ * Reads a complete file into a string.
+ *
+ * @throws InputFileException if the file can't be read
+ */
+std::string read_file(const std::string& path) {
+    // a directory can be opened but has no size
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(path, error)) {
+        throw errors::InputFileException();
+    }
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open()) {
+        throw errors::InputFileException();
+    }
+    const std::streamoff size = ifs.tellg();
+    if (size < 0) {
+        throw errors::InputFileException();
+    }
+    std::string content;
+    content.resize(size);
+    ifs.seekg(0);
+    if (!ifs.read(content.data(), content.size())) {
+        throw errors::InputFileException();
+    }
+    return content;
+}
+
+/**
+ * Asks the OS to start reading a file into the page cache in the background
+ * so it is (hopefully) already in memory when it is needed. Best effort,
+ * errors are ignored.
+ */
+void prefetch_file([[maybe_unused]] const std::string& path) {
+#ifdef POSIX_FADV_WILLNEED
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#endif
+}
+
+/**
+ * Output of a single file: either the result or an error message.
+ */
+struct FileOutput {
+    std::string output;
+    std::string error;
+};
+
+/**
+ * Reads one file, applies the selectors and returns the result followed by a
+ * newline (or the error message).
+ */
+FileOutput process_file(const std::string& path, std::size_t number,
+                        const selectors::Selectors& selectors,
+                        const selectors::ApplyContext& ctx,
+                        const FilesOptions& options) {
+    trace::Span span("file", "number", number);
+    FileOutput result;
+    const std::string prefix = options.with_filename ? path + ":" : "";
+    try {
+        const std::string content = read_file(path);
+        std::ostringstream out;
+        out << prefix;
+        process_record(content, number, out, selectors, ctx);
+        result.output = out.str();
+    } catch (const errors::InputFileException& e) {
+        result.error = path + ": " + e.what();
+    } catch (const RecordError& e) {
+        result.error = path + ": " + e.get_message();
+    } catch (const std::exception& e) {
+        // e.g. out of memory, only this file fails
+        result.error = path + ": " + e.what();
+    }
+    return result;
+}
+
+/**
+ * Applies the selectors to every file in `files` and writes the results to
+ * `out` in the order of `files`, one line per file. Files that fail are
+ * reported on `err` (in the same order) and don't stop the other files.
+ *
+ * With a pool in `ctx` the files are processed in parallel. At most
+ * `max_in_flight` files are held in memory at once: a file is only started
+ * when the oldest one has been written. The next `prefetch` files are
+ * prefetched (see prefetch_file) so reading overlaps with parsing even
+ * without a pool.
+ */
+FilesResult process_files(const std::vector<std::string>& files,
+                          std::ostream& out, std::ostream& err,
+                          const selectors::Selectors& selectors,
+                          const selectors::ApplyContext& ctx,
+                          const FilesOptions& options = {}) {
+    FilesResult result;
+    auto write = [&](const FileOutput& file) {
+        if (file.error.empty()) {
+            out << file.output;
+        } else {
+            err << file.error << '\n';
+            ++result.failed;
+        }
+        ++result.processed;
+    };
+
+    std::size_t prefetched = 0;
+    auto prefetch_until = [&](std::size_t end) {
+        for (; prefetched < std::min(end, files.size()); ++prefetched) {
+            prefetch_file(files[prefetched]);
+        }
+    };
+
+    parallel::ThreadPool* pool = ctx.pool;
+    if (pool == nullptr) {
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            // the current file is read right away, no point in prefetching it
+            prefetched = std::max(prefetched, i + 1);
+            prefetch_until(i + 1 + options.prefetch);
+            write(process_file(files[i], i + 1, selectors, ctx, options));
+        }
+        return result;
+    }
+
+    struct Job {
+        FileOutput output;
+        std::atomic<bool> done = false;
+    };
+    // shared with the tasks so they can signal that they are done
+    struct Window {
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    const std::size_t max_in_flight =
+        options.max_in_flight != 0 ? options.max_in_flight
+                                   : 2 * (pool->size() + 1);
+    auto window_sync = std::make_shared<Window>();
+    std::deque<std::shared_ptr<Job>> window;
+
+    auto submit = [&](std::size_t i) {
+        auto job = std::make_shared<Job>();
+        window.push_back(job);
+        pool->submit([job, window_sync, &files, i, &selectors, ctx, &options] {
+            job->output =
+                process_file(files[i], i + 1, selectors, ctx, options);
+
+            job->done = true;
+            std::lock_guard lock(window_sync->mutex);
+            window_sync->changed.notify_all();
+        });
+    };
+
+    std::size_t next = 0;
+    while (next < files.size() || !window.empty()) {
+        while (next < files.size() && window.size() < max_in_flight) {
+            prefetch_until(next + 1 + options.prefetch);
+            submit(next++);
+        }
+
+        // wait for the oldest file, running queued tasks in the meantime
+        const std::shared_ptr<Job> front = window.front();
+        auto ready = [&front] { return front->done.load(); };
+        while (!ready()) {
+            if (pool->run_one()) {
+                continue;
+            }
+            std::unique_lock lock(window_sync->mutex);
+            window_sync->changed.wait(lock, ready);
+        }
+        write(front->output);
+        window.pop_front();
+    }
+    return result;
+}
+
+} // namespace stream
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef JSON_QUERY_STREAM_LINES_HPP
+#define JSON_QUERY_STREAM_LINES_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "../parallel/thread_pool.hpp"
+#include "../selectors/selectors.hpp"
+#include "../trace/trace.hpp"
+#include "../json/json.hpp"
+
+namespace stream {
+
+/**
+ * Error while processing one record of a stream of json documents.
+ *
+ * Contains the (1 indexed) number of the record and the message of the
+ * original error.
+ */
+class RecordError : public std::exception {
+    std::size_t record;
+    std::string message;
+    std::string what_;
+
+public:
+    RecordError(std::size_t record, const std::string& message)
+        : record(record), message(message),
+          what_("record " + std::to_string(record) + ": " + message) {}
+
+    std::size_t get_record() const { return record; }
+
+    /**
+     * Message of the original error (without the record number).
+     */
+    const std::string& get_message() const { return message; }
+
+    const char* what() const noexcept override { return what_.c_str(); }
+};
+
+/**
+ * Parses a single record, applies the selectors and writes the result
+ * followed by a newline to `out`.
+ *
+ * Throws RecordError if the record is not valid json or the selectors can't
+ * be applied to it.
+ */
+void process_record(const std::string& record, std::size_t number,
+                    std::ostream& out, const selectors::Selectors& selectors,
+                    const selectors::ApplyContext& ctx) {
+    try {
+        json::JsonNode json = json::parse_json(record);
+        out << selectors.apply(json, ctx) << '\n';
+    } catch (const json::SyntaxError& e) {
+        throw RecordError(number, e.what());
+    } catch (const json::FailedToParseJsonException& e) {
+        throw RecordError(number, e.what());
+    } catch (const selectors::ApplySelectorError& e) {
+        throw RecordError(number, e.what());
+    }
+}
+
+/**
+ * Returns true if the line contains nothing but whitespace.
+ */
+bool is_blank(std::string_view line) {
+    return line.find_first_not_of(" \t\r") == std::string_view::npos;
+}
+
+/**
+ * Processes newline delimited json (NDJSON/JSON Lines): every line of `in` is
+ * a separate json document. The selectors are applied to each of them and
+ * the results are written to `out`, one line per record.
+ *
+ * Only one line is kept in memory at a time (and the buffer for it is reused)
+ * so memory usage does not depend on the size of the input. Empty lines are
+ * skipped.
+ *
+ * Returns the number of records processed. Throws RecordError (with the line
+ * number) on the first record that fails.
+ */
+std::size_t process_lines(std::istream& in, std::ostream& out,
+                          const selectors::Selectors& selectors,
+                          const selectors::ApplyContext& ctx) {
+    std::string line;
+    std::size_t line_number = 0;
+    std::size_t records = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        if (is_blank(line)) {
+            continue;
+        }
+        process_record(line, line_number, out, selectors, ctx);
+        ++records;
+    }
+    return records;
+}
+
+/**
+ * Processes all lines of an in memory buffer like process_lines.
+ *
+ * `first_line` is the line number of the first line in the buffer (used for
+ * errors). Lines are found with `memchr` which is vectorized by the C
+ * library.
+ */
+std::size_t process_buffer(std::string_view data, std::size_t first_line,
+                           std::ostream& out,
+                           const selectors::Selectors& selectors,
+                           const selectors::ApplyContext& ctx) {
+    std::string line;
+    std::size_t line_number = first_line;
+    std::size_t records = 0;
+    const char* pos = data.data();
+    const char* const end = data.data() + data.size();
+    while (pos < end) {
+        const char* newline =
+            static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* line_end = newline != nullptr ? newline : end;
+
+        line.assign(pos, line_end);
+        if (!is_blank(line)) {
+            process_record(line, line_number, out, selectors, ctx);
+            ++records;
+        }
+
+        ++line_number;
+        pos = line_end + 1;
+    }
+    return records;
+}
+
+/**
+ * Counts the newlines in a buffer.
+ */
+std::size_t count_lines(std::string_view data) {
+    std::size_t lines = 0;
+    const char* pos = data.data();
+    const char* const end = data.data() + data.size();
+    while ((pos = static_cast<const char*>(
+                std::memchr(pos, '\n', end - pos))) != nullptr) {
+        ++lines;
+        ++pos;
+    }
+    return lines;
+}
+
+/**
+ * Settings for process_lines_parallel.
+ */
+struct ParallelLinesOptions {
+    // number of bytes read at once (the chunks are cut at the last newline so
+    // the actual chunks are a bit smaller or larger)
+    std::size_t chunk_size = 4 << 20;
+    // maximum number of chunks that have been read but not written yet (this
+    // bounds the memory use), 0 means 2 per thread
+    std::size_t max_in_flight = 0;
+    // write the results in the order of the input, otherwise whole chunks are
+    // written as soon as they are done
+    bool ordered = true;
+};
+
+/**
+ * Like process_lines but with the parsing and the selectors running on the
+ * pool from `ctx`.
+ *
+ * The calling thread reads the input in large chunks that end at a newline
+ * and hands them to the pool. Finished chunks are written to `out`. In
+ * ordered mode that happens through a reorder window: a chunk is only written
+ * after all chunks before it, so the output is the same as with
+ * process_lines. At most `max_in_flight` chunks are kept in memory, reading
+ * waits until the oldest chunk is written.
+ *
+ * If a record fails the results of the records before it are written (in
+ * ordered mode) and its RecordError is rethrown.
+ *
+ * Without a pool this is just process_lines.
+ */
+std::size_t process_lines_parallel(std::istream& in, std::ostream& out,
+                                   const selectors::Selectors& selectors,
+                                   const selectors::ApplyContext& ctx,
+                                   const ParallelLinesOptions& options) {
+    parallel::ThreadPool* pool = ctx.pool;
+    if (pool == nullptr) {
+        return process_lines(in, out, selectors, ctx);
+    }
+
+    struct Chunk {
+        std::string data;
+        std::size_t first_line = 1;
+        std::string output;
+        std::size_t records = 0;
+        std::exception_ptr error;
+        std::atomic<bool> done = false;
+    };
+    // shared with the tasks so they can signal that they are done
+    struct Window {
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    const std::size_t max_in_flight =
+        options.max_in_flight != 0 ? options.max_in_flight
+                                   : 2 * (pool->size() + 1);
+    auto window_sync = std::make_shared<Window>();
+    std::deque<std::shared_ptr<Chunk>> window;
+
+    std::string carry;
+    std::size_t next_line = 1;
+    bool input_done = false;
+
+    // reads the next chunk that ends with a newline (or the end of the input)
+    auto read_chunk = [&]() -> std::shared_ptr<Chunk> {
+        trace::Span span("read_chunk");
+        std::string data = std::move(carry);
+        carry.clear();
+        while (in) {
+            const std::size_t old_size = data.size();
+            data.resize(old_size + options.chunk_size);
+            in.read(data.data() + old_size, options.chunk_size);
+            data.resize(old_size + in.gcount());
+
+            // (memrchr is a GNU extension but available on all platforms we
+            // care about)
+            const char* last = static_cast<const char*>(
+                memrchr(data.data() + old_size, '\n', data.size() - old_size));
+            if (last != nullptr) {
+                const std::size_t cut = last - data.data() + 1;
+                carry.assign(data, cut);
+                data.resize(cut);
+                break;
+            }
+            // a line longer than the chunk size: keep reading
+        }
+        if (data.empty()) {
+            return nullptr;
+        }
+        auto chunk = std::make_shared<Chunk>();
+        chunk->first_line = next_line;
+        next_line += count_lines(data);
+        chunk->data = std::move(data);
+        return chunk;
+    };
+
+    auto submit = [&](std::shared_ptr<Chunk> chunk) {
+        pool->submit([chunk, window_sync, &selectors, ctx] {
+            trace::Span span("chunk", "first_line", chunk->first_line);
+            std::ostringstream chunk_out;
+            try {
+                chunk->records = process_buffer(chunk->data, chunk->first_line,
+                                                chunk_out, selectors, ctx);
+            } catch (...) {
+                chunk->error = std::current_exception();
+            }
+            chunk->output = chunk_out.str();
+            chunk->data = std::string();
+
+            chunk->done = true;
+            std::lock_guard lock(window_sync->mutex);
+            window_sync->changed.notify_all();
+        });
+    };
+
+    auto is_done = [](const std::shared_ptr<Chunk>& chunk) {
+        return chunk->done.load();
+    };
+
+    // waits until `ready` is true, running queued tasks in the meantime
+    auto wait_for = [&](const auto& ready) {
+        while (!ready()) {
+            if (pool->run_one()) {
+                continue;
+            }
+            std::unique_lock lock(window_sync->mutex);
+            window_sync->changed.wait(lock, ready);
+        }
+    };
+
+    std::size_t records = 0;
+    std::exception_ptr error;
+    auto write = [&](Chunk& chunk) {
+        out.write(chunk.output.data(), chunk.output.size());
+        records += chunk.records;
+        if (chunk.error && !error) {
+            error = chunk.error;
+        }
+    };
+
+    while (!error && (!input_done || !window.empty())) {
+        while (!input_done && window.size() < max_in_flight) {
+            std::shared_ptr<Chunk> chunk = read_chunk();
+            if (!chunk) {
+                input_done = true;
+                break;
+            }
+            window.push_back(chunk);
+            submit(std::move(chunk));
+        }
+        if (window.empty()) {
+            break;
+        }
+
+        if (options.ordered) {
+            wait_for([&] { return is_done(window.front()); });
+            while (!error && !window.empty() && is_done(window.front())) {
+                write(*window.front());
+                window.pop_front();
+            }
+        } else {
+            wait_for([&] { return std::ranges::any_of(window, is_done); });
+            for (auto it = window.begin(); !error && it != window.end();) {
+                if (is_done(*it)) {
+                    write(**it);
+                    it = window.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    if (error) {
+        // the tasks still running reference the selectors
+        wait_for([&] { return std::ranges::all_of(window, is_done); });
+        std::rethrow_exception(error);
+    }
+    return records;
+}
+
+} // namespace stream
+
+#endif
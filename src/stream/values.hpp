@@ -0,0 +1,131 @@
+#ifndef JSON_QUERY_STREAM_VALUES_HPP
+#define JSON_QUERY_STREAM_VALUES_HPP
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include "../selectors/selectors.hpp"
+#include "lines.hpp"
+
+namespace stream {
+
+/**
+ * Splits a stream of concatenated json values (`{...}{...}[...]`, values
+ * separated by whitespace, pretty printed values spanning several lines, ...)
+ * into the individual values without parsing them.
+ *
+ * Only the brackets outside of strings are counted, so this is a lot cheaper
+ * than the actual parser. Values that are not valid json are still returned
+ * as one value (as far as they can be told apart) and the parser reports the
+ * error later.
+ */
+class ValueReader {
+    std::streambuf* buf;
+
+public:
+    explicit ValueReader(std::istream& in) : buf(in.rdbuf()) {}
+
+    /**
+     * Reads the next value into `value` (the buffer is reused).
+     *
+     * Returns false if there are no more values (only whitespace left).
+     */
+    bool next(std::string& value);
+
+private:
+    static constexpr int eof = std::char_traits<char>::eof();
+
+    static bool is_space(int c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // characters that end a number or literal at the top level
+    static bool is_delimiter(int c) {
+        return is_space(c) || c == '{' || c == '[' || c == '"' || c == '}' ||
+               c == ']' || c == ',' || c == eof;
+    }
+
+    int take(std::string& value) {
+        const int c = buf->sbumpc();
+        if (c != eof) {
+            value.push_back(static_cast<char>(c));
+        }
+        return c;
+    }
+
+    // reads the rest of a string after the opening quote
+    void read_string(std::string& value) {
+        int c;
+        while ((c = take(value)) != eof && c != '"') {
+            if (c == '\\') {
+                take(value);
+            }
+        }
+    }
+};
+
+bool ValueReader::next(std::string& value) {
+    value.clear();
+
+    int c;
+    while ((c = buf->sgetc()) != eof && is_space(c)) {
+        buf->sbumpc();
+    }
+    if (c == eof) {
+        return false;
+    }
+
+    c = take(value);
+    if (c == '"') {
+        read_string(value);
+    } else if (c == '{' || c == '[') {
+        std::size_t depth = 1;
+        while (depth > 0 && (c = take(value)) != eof) {
+            if (c == '"') {
+                read_string(value);
+            } else if (c == '{' || c == '[') {
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                --depth;
+            }
+        }
+    } else {
+        // number or literal (or a stray `}`, `,`, ... which is returned on
+        // its own)
+        while (!is_delimiter(c) && !is_delimiter(buf->sgetc())) {
+            c = take(value);
+        }
+    }
+    return true;
+}
+
+/**
+ * Processes a stream of concatenated json values (see ValueReader). The
+ * selectors are applied to each value and the results are written to `out`,
+ * one line per value.
+ *
+ * Only one value is kept in memory at a time, so the memory usage is bounded
+ * by the largest value and not by the size of the input.
+ *
+ * Returns the number of values processed. Throws RecordError (with the number
+ * of the value) on the first value that fails.
+ */
+std::size_t process_values(std::istream& in, std::ostream& out,
+                           const selectors::Selectors& selectors,
+                           const selectors::ApplyContext& ctx) {
+    ValueReader reader(in);
+    std::string value;
+    std::size_t records = 0;
+    while (reader.next(value)) {
+        ++records;
+        process_record(value, records, out, selectors, ctx);
+    }
+    return records;
+}
+
+} // namespace stream
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef JSON_QUERY_TRACE_TRACE_HPP
+#define JSON_QUERY_TRACE_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Trace of --trace in the Chrome trace event format (can be opened with
+// chrome://tracing or https://ui.perfetto.dev).
+//
+// Every thread records its spans into its own buffer, only the owning thread
+// ever writes to it, so recording needs no locks or atomic read-modify-write
+// operations. The only lock is taken once per thread, when its first span
+// registers the buffer. The buffer has room for MAX_EVENTS events from the
+// start so recording never allocates; further events of the thread are
+// dropped and counted. The buffers are only read by write() after all work
+// is done (joining the work is what makes the events of the other threads
+// visible). When tracing is off a Span costs one relaxed atomic load.
+namespace trace {
+
+// per thread (40 bytes each)
+constexpr std::size_t MAX_EVENTS = 1 << 16;
+
+struct Event {
+    // names have to be string literals (nothing is allocated per event)
+    const char* name;
+    const char* arg_name;
+    std::int64_t arg;
+    std::int64_t start_ns;
+    std::int64_t end_ns;
+};
+
+namespace detail {
+
+struct ThreadBuffer {
+    std::size_t id;
+    std::string name;
+    std::vector<Event> events;
+    // events that didn't fit into `events` anymore
+    std::size_t dropped = 0;
+};
+
+struct Registry {
+    std::mutex mutex;
+    // kept after the threads exit so their events can still be written
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::chrono::steady_clock::time_point start;
+};
+
+inline std::atomic<bool> enabled{false};
+
+Registry& registry() {
+    static Registry registry;
+    return registry;
+}
+
+/**
+ * Buffer of the current thread, registered on first use (the only time the
+ * registry is locked).
+ */
+ThreadBuffer& thread_buffer() {
+    static thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        Registry& r = registry();
+        std::lock_guard lock(r.mutex);
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->id = r.buffers.size() + 1;
+        buffer->name = "thread " + std::to_string(buffer->id);
+        buffer->events.reserve(MAX_EVENTS);
+        r.buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - registry().start)
+        .count();
+}
+
+} // namespace detail
+
+/**
+ * Starts recording spans (on all threads).
+ */
+void enable() {
+    detail::registry().start = std::chrono::steady_clock::now();
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Stops recording spans (the recorded ones are kept).
+ */
+void disable() { detail::enabled.store(false, std::memory_order_relaxed); }
+
+bool is_enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+/**
+ * Sets the name the current thread is shown with.
+ */
+void name_thread(const std::string& name) {
+    if (is_enabled()) {
+        detail::thread_buffer().name = name;
+    }
+}
+
+/**
+ * Records the time from its construction to its destruction as a span on the
+ * current thread (if tracing is enabled). `arg_name` and `arg` are shown as
+ * argument of the span (e.g. the index of a root selector).
+ */
+class Span {
+    const char* name;
+    const char* arg_name;
+    std::int64_t arg;
+    std::int64_t start = -1;
+
+public:
+    explicit Span(const char* name, const char* arg_name = nullptr,
+                  std::int64_t arg = 0)
+        : name(name), arg_name(arg_name), arg(arg) {
+        if (is_enabled()) {
+            start = detail::now_ns();
+        }
+    }
+
+    ~Span() {
+        if (start < 0) {
+            return;
+        }
+        const std::int64_t end = detail::now_ns();
+        detail::ThreadBuffer& buffer = detail::thread_buffer();
+        if (buffer.events.size() < MAX_EVENTS) {
+            buffer.events.push_back(Event{name, arg_name, arg, start, end});
+        } else {
+            ++buffer.dropped;
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+};
+
+/**
+ * Runs `f` inside a span called `name` and returns its result.
+ */
+template <typename F> decltype(auto) traced(const char* name, F&& f) {
+    Span span(name);
+    return f();
+}
+
+/**
+ * Number of events that were dropped because the buffer of their thread was
+ * full.
+ *
+ * Must only be called when no other thread records spans anymore.
+ */
+std::size_t dropped_events() {
+    detail::Registry& r = detail::registry();
+    std::lock_guard lock(r.mutex);
+    std::size_t dropped = 0;
+    for (const auto& buffer : r.buffers) {
+        dropped += buffer->dropped;
+    }
+    return dropped;
+}
+
+/**
+ * Writes all recorded events as a Chrome trace (json object format). The
+ * number of dropped events of a thread is an argument of its name.
+ *
+ * Must only be called when no other thread records spans anymore.
+ */
+void write(std::ostream& o) {
+    detail::Registry& r = detail::registry();
+    std::lock_guard lock(r.mutex);
+    o << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    const char* sep = "\n";
+    for (const auto& buffer : r.buffers) {
+        o << sep << R"({"name":"thread_name","ph":"M","pid":1,"tid":)"
+          << buffer->id << R"(,"args":{"name":")" << buffer->name << '"';
+        if (buffer->dropped > 0) {
+            o << ",\"dropped_events\":" << buffer->dropped;
+        }
+        o << "}}";
+        sep = ",\n";
+        for (const Event& event : buffer->events) {
+            // timestamps are in microseconds
+            o << sep << R"({"name":")" << event.name
+              << R"(","cat":"jsonquery","ph":"X","pid":1,"tid":)"
+              << buffer->id << ",\"ts\":" << event.start_ns / 1e3
+              << ",\"dur\":" << (event.end_ns - event.start_ns) / 1e3;
+            if (event.arg_name != nullptr) {
+                o << ",\"args\":{\"" << event.arg_name << "\":" << event.arg
+                  << "}";
+            }
+            o << "}";
+        }
+    }
+    o << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+} // namespace trace
+
+#endif
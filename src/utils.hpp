@@ -2,6 +2,8 @@
 #define JSONQUERY_UTILS_HPP
 
 #include <concepts>
+#include <utility>
+#include <variant>
 
 template <class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 template <class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
@@ -24,4 +26,43 @@ concept basically_same_as =
     std::same_as<Check, const Fixed&>;
 // clang-format on
 
+/**
+ * Wrapper to construct an Expected that contains an error (like C++23's
+ * `std::unexpected`).
+ */
+template <typename E> class Unexpected {
+    E error_;
+
+public:
+    explicit Unexpected(E error) : error_(std::move(error)) {}
+
+    const E& error() const { return error_; }
+};
+
+/**
+ * Contains either a value or an error.
+ *
+ * This is a minimal version of C++23's `std::expected` (we are on C++20) with
+ * the same interface so it can be replaced once we switch. It is used where
+ * failing is common and has to be cheap, so exceptions are not an option.
+ */
+template <typename T, typename E> class Expected {
+    std::variant<T, E> inner;
+
+public:
+    Expected(T value) : inner(std::in_place_index<0>, std::move(value)) {}
+    Expected(Unexpected<E> error)
+        : inner(std::in_place_index<1>, error.error()) {}
+
+    bool has_value() const { return inner.index() == 0; }
+    explicit operator bool() const { return has_value(); }
+
+    const T& operator*() const& { return std::get<0>(inner); }
+    T& operator*() & { return std::get<0>(inner); }
+    T&& operator*() && { return std::get<0>(std::move(inner)); }
+    const T* operator->() const { return &std::get<0>(inner); }
+
+    const E& error() const { return std::get<1>(inner); }
+};
+
 #endif
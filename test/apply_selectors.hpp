@@ -1,6 +1,9 @@
 #include <catch/catch.hpp>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "selectors/queries.hpp"
 #include "selectors/selectors.hpp"
 #include "json/json.hpp"
 
@@ -210,3 +213,86 @@ TEST_CASE("apply multiple root selectors", "[selectors]") {
     REQUIRE(array[2] == json);
 }
 
+TEST_CASE("apply multiple root selectors in parallel", "[selectors]") {
+    JsonNode json = parse_json(
+        R"#({ "key1": [1, 2, 3], "key2": { "key3": 3 }, "key4": "x" })#");
+    Selectors selectors = parse_selectors(
+        R"#("key1", "key2"."key3", "key4", "key1"[1:2], ., "key2"!)#");
+    parallel::ThreadPool pool(3);
+    JsonNode result = selectors.apply(json, &pool);
+    REQUIRE(result == selectors.apply(json));
+}
+
+TEST_CASE("apply multiple root selectors in parallel reports first error",
+          "[selectors]") {
+    JsonNode json = parse_json(R"#({ "key1": 1 })#");
+    Selectors selectors = parse_selectors(R"#("key1", "key2", "key3")#");
+    parallel::ThreadPool pool(2);
+    REQUIRE_THROWS_WITH(selectors.apply(json, &pool),
+                        "Key \"key2\" was not found in json object");
+}
+
+TEST_CASE("apply array selectors in parallel", "[selectors]") {
+    std::string s = "[";
+    for (int i = 0; i < 1000; ++i) {
+        s += (i == 0 ? "" : ",");
+        if (i % 3 == 0) {
+            s += R"#({"key": [)#" + std::to_string(i) + "," +
+                 std::to_string(-i) + "]}";
+        } else {
+            s += R"#({"other": )#" + std::to_string(i) + "}";
+        }
+    }
+    s += "]";
+    JsonNode json = parse_json(s);
+
+    parallel::ThreadPool pool(3);
+    ApplyContext ctx{.pool = &pool, .parallel_threshold = 16};
+
+    for (const char* selector :
+         {R"#(|"key")#", R"#(|"key"..)#", R"#([:])#", R"#([10:900]!)#",
+          R"#(|"key"[1])#", R"#(|"key"[0:0])#"}) {
+        Selectors selectors = parse_selectors(std::string(selector));
+        REQUIRE(selectors.apply(json, ctx) == selectors.apply(json));
+    }
+}
+
+TEST_CASE("apply selectors that don't match report errors", "[selectors]") {
+    JsonNode json = parse_json(R"#({ "key1": [1, 2, 3] })#");
+    REQUIRE_THROWS_WITH(parse_selectors(R"#("key2")#").apply(json),
+                        "Key \"key2\" was not found in json object");
+    REQUIRE_THROWS_WITH(parse_selectors(R"#({"key1", "key2"})#").apply(json),
+                        "Key \"key2\" was not found in json object");
+    REQUIRE_THROWS_WITH(parse_selectors(R"#("key1"[3])#").apply(json),
+                        "Index 3 is out of range of json array");
+    REQUIRE_THROWS_WITH(parse_selectors(R"#("key1"."key2")#").apply(json),
+                        "selector and json object don't match: Key, Array");
+    REQUIRE_THROWS_WITH(parse_selectors(R"#("key1"[:]"key2")#").apply(json),
+                        "selector and json object don't match: Key, Number");
+}
+
+TEST_CASE("apply many queries to one document", "[selectors]") {
+    JsonNode json = json::parse_json(R"#({"a": [1, 2, 3], "b": {"c": true}})#");
+    std::istringstream in("\"a\"\n\n\"a\"[1]\r\n  \n\"b\".\"c\"\n\"x\"\n");
+    std::vector<Query> queries = read_queries(in);
+    REQUIRE(queries.size() == 4);
+    REQUIRE(queries[1].line == 3);
+    REQUIRE(queries[1].text == "\"a\"[1]");
+    REQUIRE(queries[3].line == 6);
+
+    std::vector<Selectors> compiled = compile_queries(queries);
+    parallel::ThreadPool pool(3);
+    for (parallel::ThreadPool* p : {(parallel::ThreadPool*)nullptr, &pool}) {
+        std::vector<QueryResult> results =
+            apply_queries(json, compiled, ApplyContext{.pool = p});
+        REQUIRE(results.size() == 4);
+        REQUIRE(results[0].output == "[1,2,3]");
+        REQUIRE(results[1].output == "2");
+        REQUIRE(results[2].output == "true");
+        REQUIRE(results[3].output.empty());
+        REQUIRE(results[3].error == "Key \"x\" was not found in json object");
+    }
+
+    std::istringstream invalid("\"a\"\n\"a\"[\n");
+    REQUIRE_THROWS_AS(compile_queries(read_queries(invalid)), QueryError);
+}
@@ -0,0 +1,115 @@
+#include <catch/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "cache/cache.hpp"
+#include "selectors/selectors.hpp"
+
+namespace {
+
+std::filesystem::path fresh_cache_dir() {
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "jsonquery_test_cache";
+    std::filesystem::remove_all(path);
+    return path;
+}
+
+} // namespace
+
+TEST_CASE("cache keys", "[cache]") {
+    const std::filesystem::path file =
+        std::filesystem::temp_directory_path() / "jsonquery_cache.json";
+    std::ofstream(file, std::ios::trunc) << R"#({"a": [1, 2]})#";
+    const auto selectors = selectors::parse_selectors(R"#("a"[0], "a")#");
+
+    const std::string key = cache::make_key(file, selectors, false);
+    REQUIRE(key == cache::make_key(file, selectors, false));
+    // only the meaning of the selectors matters
+    REQUIRE(key == cache::make_key(
+                       file, selectors::parse_selectors(R"#( "a" [0],"a")#"),
+                       false));
+    REQUIRE(key != cache::make_key(
+                       file, selectors::parse_selectors(R"#("a"[1], "a")#"),
+                       false));
+    REQUIRE(key != cache::make_key(file, selectors, true));
+    // a key that looks like the structure around it
+    REQUIRE(cache::make_key(
+                file, selectors::parse_selectors(R"#("a),KeySelector(b")#"),
+                false) !=
+            cache::make_key(
+                file, selectors::parse_selectors(R"#("a"."b")#"), false));
+
+    std::ofstream(file, std::ios::trunc) << R"#({"a": [1, 2, 3]})#";
+    REQUIRE(key != cache::make_key(file, selectors, false));
+
+    REQUIRE_THROWS_AS(cache::make_key((file / "missing").string(), selectors,
+                                      false),
+                      cache::CacheError);
+}
+
+TEST_CASE("store and load results", "[cache]") {
+    cache::ResultCache cache(fresh_cache_dir().string(), 1 << 20);
+    std::ostringstream out;
+    REQUIRE(!cache.load("key 1\n", out));
+
+    cache.store("key 1\n", R"#({"a":1})#");
+    cache.store("key 2\n", "[1,2]");
+    REQUIRE(cache.load("key 1\n", out));
+    REQUIRE(out.str() == R"#({"a":1})#");
+
+    out.str("");
+    REQUIRE(cache.load("key 2\n", out));
+    REQUIRE(out.str() == "[1,2]");
+    REQUIRE(!cache.load("key 3\n", out));
+}
+
+TEST_CASE("evict least recently used results", "[cache]") {
+    const std::filesystem::path directory = fresh_cache_dir();
+    // room for two entries
+    cache::ResultCache cache(directory.string(), 2 * 1024 + 100);
+    const std::string result(1024, '1');
+    auto age = [&directory](int seconds) {
+        for (const auto& file :
+             std::filesystem::directory_iterator(directory)) {
+            std::filesystem::last_write_time(
+                file.path(), file.last_write_time() -
+                                 std::chrono::seconds(seconds));
+        }
+    };
+
+    std::ostringstream out;
+    cache.store("a\n", result);
+    age(10);
+    cache.store("b\n", result);
+    age(10);
+    // a was used after b
+    REQUIRE(cache.load("a\n", out));
+    cache.store("c\n", result);
+
+    REQUIRE(cache.load("a\n", out));
+    REQUIRE(!cache.load("b\n", out));
+    REQUIRE(cache.load("c\n", out));
+}
+
+TEST_CASE("remove temporary files left behind", "[cache]") {
+    const std::filesystem::path directory = fresh_cache_dir();
+    cache::ResultCache cache(directory.string(), 1024);
+    const std::filesystem::path stale = directory / "0.cache.tmp.1.0";
+    const std::filesystem::path fresh = directory / "0.cache.tmp.1.1";
+    std::ofstream(stale) << std::string(4096, 'x');
+    std::ofstream(fresh) << std::string(4096, 'x');
+    std::filesystem::last_write_time(
+        stale, std::filesystem::file_time_type::clock::now() -
+                   std::chrono::hours(1));
+
+    // the temporary files don't count towards the limit
+    cache.store("a\n", "1");
+    std::ostringstream out;
+    REQUIRE(cache.load("a\n", out));
+    REQUIRE(!std::filesystem::exists(stale));
+    // might still be written by another process
+    REQUIRE(std::filesystem::exists(fresh));
+}
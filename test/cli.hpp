@@ -0,0 +1,102 @@
+#include <catch/catch.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <sys/wait.h>
+
+#include "sidecar/index.hpp"
+#include "snapshot/snapshot.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+struct CliResult {
+    int status;
+    std::string output;
+};
+
+/**
+ * Runs the jsonquery binary (built next to the tests) with the arguments and
+ * returns its exit status and stdout and stderr.
+ */
+CliResult run_cli(const std::string& arguments) {
+    FILE* pipe = popen(("./jsonquery " + arguments + " 2>&1").c_str(), "r");
+    REQUIRE(pipe != nullptr);
+    std::string output;
+    std::array<char, 4096> buffer;
+    while (std::size_t n = std::fread(buffer.data(), 1, buffer.size(), pipe)) {
+        output.append(buffer.data(), n);
+    }
+    const int status = pclose(pipe);
+    return {WIFEXITED(status) ? WEXITSTATUS(status) : -1, output};
+}
+
+/**
+ * A path in the temp directory whose name is too long for the small string
+ * optimization.
+ */
+std::filesystem::path long_temp_path(const std::string& extension) {
+    return std::filesystem::temp_directory_path() /
+           ("jsonquery_test_with_a_rather_long_file_name" + extension);
+}
+
+} // namespace
+
+TEST_CASE("query a snapshot with a long path", "[cli]") {
+    if (!std::filesystem::exists("./jsonquery")) {
+        WARN("./jsonquery is not built");
+        return;
+    }
+    const std::string path = long_temp_path(".jqs").string();
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        snapshot::write_snapshot(
+            json::parse_json(R"#({"a": {"b": [1, 2]}})#"), out);
+    }
+
+    const CliResult result = run_cli(R"#('"a"."b"' )#" + path);
+    REQUIRE(result.output == "[1,2]");
+    REQUIRE(result.status == 0);
+}
+
+TEST_CASE("reject numbers that don't fit into an option", "[cli]") {
+    if (!std::filesystem::exists("./jsonquery")) {
+        WARN("./jsonquery is not built");
+        return;
+    }
+    // 2^32 + 1 would wrap around to 1
+    const CliResult result = run_cli(R"#(--threads 4294967297 '"a"')#");
+    REQUIRE(result.status == 1);
+    REQUIRE(result.output.starts_with("--threads requires a number"));
+}
+
+TEST_CASE("query a file with a damaged sidecar index", "[cli]") {
+    if (!std::filesystem::exists("./jsonquery")) {
+        WARN("./jsonquery is not built");
+        return;
+    }
+    const std::string path = long_temp_path(".json").string();
+    std::ofstream(path, std::ios::trunc) << R"#({"a": [1, 2], "b": 3})#";
+    sidecar::build_index(path, 1);
+    const std::uint64_t root = sidecar::Index::open(path)->root();
+    {
+        // key offset of the first member and end of the second one
+        std::fstream index(sidecar::index_path(path),
+                           std::ios::binary | std::ios::in | std::ios::out);
+        const std::uint64_t far = std::uint64_t{1} << 40;
+        index.seekp(root + 16);
+        index.write(reinterpret_cast<const char*>(&far), sizeof(far));
+        index.seekp(root + 16 + 40 + 24);
+        index.write(reinterpret_cast<const char*>(&far), sizeof(far));
+    }
+
+    const CliResult result = run_cli(R"#('"a", "b"' )#" + path);
+    REQUIRE(result.output == "[[1,2],3]");
+    REQUIRE(result.status == 0);
+    std::filesystem::remove(sidecar::index_path(path));
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,70 @@
+#include <catch/catch.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "corpus/corpus.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+std::string generate_corpus(corpus::Shape shape, std::uint64_t bytes,
+                            std::uint64_t seed) {
+    std::ostringstream out;
+    const std::uint64_t written = corpus::generate(out, shape, bytes, seed);
+    REQUIRE(written == out.str().size());
+    return out.str();
+}
+
+} // namespace
+
+TEST_CASE("corpus shapes are valid json of about the size", "[corpus]") {
+    for (const corpus::Shape shape : corpus::SHAPES) {
+        INFO(corpus::shape_name(shape));
+        REQUIRE(corpus::parse_shape(corpus::shape_name(shape)) == shape);
+
+        const std::string content = generate_corpus(shape, 64 * 1024, 7);
+        REQUIRE(content.size() >= 64 * 1024);
+        // stops after the item that reached the size
+        REQUIRE(content.size() < 80 * 1024);
+
+        if (shape == corpus::Shape::NDJSON) {
+            std::istringstream lines(content);
+            std::size_t count = 0;
+            for (std::string line; std::getline(lines, line); ++count) {
+                REQUIRE_NOTHROW(json::parse_json(line));
+            }
+            REQUIRE(count > 100);
+        } else {
+            REQUIRE_NOTHROW(json::parse_json(content));
+        }
+    }
+}
+
+TEST_CASE("corpus is deterministic", "[corpus]") {
+    for (const corpus::Shape shape : corpus::SHAPES) {
+        REQUIRE(generate_corpus(shape, 4096, 1) ==
+                generate_corpus(shape, 4096, 1));
+        REQUIRE(generate_corpus(shape, 4096, 1) !=
+                generate_corpus(shape, 4096, 2));
+    }
+    // a small document is the start of a larger one
+    const std::string small =
+        generate_corpus(corpus::Shape::NDJSON, 1000, 3);
+    REQUIRE(generate_corpus(corpus::Shape::NDJSON, 5000, 3)
+                .starts_with(small));
+
+    // an empty document is still valid json
+    REQUIRE_NOTHROW(
+        json::parse_json(generate_corpus(corpus::Shape::RECORDS, 0, 1)));
+}
+
+TEST_CASE("corpus sizes and shapes", "[corpus]") {
+    REQUIRE(corpus::parse_size("512") == 512);
+    REQUIRE(corpus::parse_size("64K") == 64 * 1024);
+    REQUIRE(corpus::parse_size("10MB") == 10 * 1024 * 1024);
+    REQUIRE(corpus::parse_size("20G") == 20ull << 30);
+    REQUIRE_THROWS_AS(corpus::parse_size("ten"), corpus::CorpusError);
+    REQUIRE_THROWS_AS(corpus::parse_size("1T"), corpus::CorpusError);
+    REQUIRE_THROWS_AS(corpus::parse_shape("csv"), corpus::CorpusError);
+}
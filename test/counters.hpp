@@ -0,0 +1,78 @@
+#include <catch/catch.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "counters/counters.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+/**
+ * Counters that changed since `before`.
+ */
+counters::Values counted_since(const counters::Values& before) {
+    counters::Values now = counters::totals();
+    for (std::size_t i = 0; i < now.size(); ++i) {
+        now[i] -= before[i];
+    }
+    return now;
+}
+
+} // namespace
+
+TEST_CASE("counters of the parser", "[counters]") {
+    const std::string content =
+        R"#({"a": [1, 2.5, "x", true, null, [], {}], "b": {"c": false}})#";
+    const counters::Values before = counters::totals();
+    json::parse_json<counters::PerThread>(content);
+    const counters::Values counted = counted_since(before);
+
+    REQUIRE(counted[counters::OBJECTS_PARSED] == 3);
+    REQUIRE(counted[counters::ARRAYS_PARSED] == 2);
+    REQUIRE(counted[counters::STRINGS_PARSED] == 1);
+    REQUIRE(counted[counters::NUMBERS_PARSED] == 2);
+    REQUIRE(counted[counters::LITERALS_PARSED] == 3);
+    REQUIRE(counted[counters::BYTES_SCANNED] == content.size());
+
+    const counters::Values before_error = counters::totals();
+    REQUIRE_THROWS(json::parse_json<counters::PerThread>("[1,"));
+    REQUIRE(counted_since(before_error)[counters::EXCEPTIONS] == 1);
+}
+
+TEST_CASE("counters of exited threads are kept", "[counters]") {
+    const counters::Values before = counters::totals();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([] {
+            counters::add<counters::PerThread>(counters::KEY_LOOKUPS, 10);
+            counters::add<counters::PerThread>(counters::KEY_MISSES);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const counters::Values counted = counted_since(before);
+    REQUIRE(counted[counters::KEY_LOOKUPS] == 40);
+    REQUIRE(counted[counters::KEY_MISSES] == 4);
+}
+
+TEST_CASE("count vector reallocations", "[counters]") {
+    const counters::Values before = counters::totals();
+    std::vector<int> vec;
+    vec.reserve(2);
+    counters::push_back<counters::PerThread>(vec, 1);
+    counters::push_back<counters::PerThread>(vec, 2);
+    REQUIRE(counted_since(before)[counters::VECTOR_REALLOCATIONS] == 0);
+    counters::push_back<counters::PerThread>(vec, 3);
+    REQUIRE(counted_since(before)[counters::VECTOR_REALLOCATIONS] == 1);
+    REQUIRE(vec == std::vector<int>{1, 2, 3});
+}
+
+TEST_CASE("disabled counters count nothing", "[counters]") {
+    const counters::Values before = counters::totals();
+    counters::add<counters::Disabled>(counters::EXCEPTIONS, 5);
+    json::parse_json<counters::Disabled>("[1, 2]");
+    REQUIRE(counted_since(before)[counters::EXCEPTIONS] == 0);
+    REQUIRE(counted_since(before)[counters::ARRAYS_PARSED] == 0);
+}
@@ -0,0 +1,71 @@
+#include <catch/catch.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "parallel/thread_pool.hpp"
+#include "selectors/selectors.hpp"
+#include "json/json.hpp"
+
+using namespace selectors;
+
+TEST_CASE("explain prints the selectors as a plan tree", "[explain]") {
+    std::ostringstream out;
+    explain(out, parse_selectors(R"#("a"[1:]|"b", .."x"{"k", "j"}, [2]!)#"));
+    REQUIRE(out.str() == "Selectors (3 root selectors)\n"
+                         "-> Root 0\n"
+                         "   -> Key \"a\"\n"
+                         "      -> Range [1:]\n"
+                         "         -> Filter |\"b\"\n"
+                         "-> Root 1\n"
+                         "   -> Flatten ..\n"
+                         "      -> Key \"x\"\n"
+                         "         -> Property {\"k\", \"j\"}\n"
+                         "-> Root 2\n"
+                         "   -> Index [2]\n"
+                         "      -> Truncate !\n");
+}
+
+TEST_CASE("explain analyze counts every step", "[explain]") {
+    const JsonNode json = parse_json(
+        R"#({"x": [{"a": [1]}, {"b": 2}, {"a": [3]}, 4], "y": {"k": 1}})#");
+    const Selectors selectors =
+        parse_selectors(R"#("x"|"a"[0], "y"{"k", "j"}, "x"[0:1]."a")#");
+    parallel::ThreadPool pool(2);
+
+    for (parallel::ThreadPool* p : {(parallel::ThreadPool*)nullptr, &pool}) {
+        auto profile = make_profile(selectors);
+        REQUIRE_THROWS_AS(
+            selectors.apply(json, ApplyContext{.pool = p,
+                                               .parallel_threshold = 1,
+                                               .profile = profile.get()}),
+            ApplySelectorError);
+
+        auto counts = [&profile](std::size_t chain, std::size_t step) {
+            const Profile::Step& s = profile->get(chain, step);
+            return std::vector<std::uint64_t>{s.visited, s.emitted, s.missed};
+        };
+        // "x"|"a"[0]
+        REQUIRE(counts(0, 0) == std::vector<std::uint64_t>{1, 1, 0});
+        REQUIRE(counts(0, 1) == std::vector<std::uint64_t>{1, 2, 1});
+        REQUIRE(counts(0, 2) == std::vector<std::uint64_t>{2, 2, 0});
+        // "y"{"k", "j"}
+        REQUIRE(counts(1, 0) == std::vector<std::uint64_t>{1, 1, 0});
+        REQUIRE(counts(1, 1) == std::vector<std::uint64_t>{1, 1, 1});
+        // "x"[0:1]."a": the second item has no "a"
+        REQUIRE(counts(2, 1) == std::vector<std::uint64_t>{1, 2, 0});
+        REQUIRE(counts(2, 2) == std::vector<std::uint64_t>{2, 1, 1});
+
+        std::ostringstream out;
+        explain(out, selectors, profile.get());
+        REQUIRE(out.str().find(
+                    "-> Filter |\"a\"  (visited=1 emitted=2 missed=1 time=") !=
+                std::string::npos);
+    }
+
+    // same result with and without profile
+    const Selectors ok = parse_selectors(R"#("x"|"a"[0], "y"{"k"})#");
+    auto profile = make_profile(ok);
+    REQUIRE(ok.apply(json, ApplyContext{.profile = profile.get()}) ==
+            ok.apply(json));
+}
@@ -0,0 +1,152 @@
+#include <catch/catch.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include "parallel/thread_pool.hpp"
+#include "selectors/selectors.hpp"
+#include "sidecar/index.hpp"
+#include "json/json.hpp"
+
+namespace {
+
+std::string write_indexed_json(const std::string& content) {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_index.json")
+            .string();
+    std::ofstream(path, std::ios::trunc) << content;
+    return path;
+}
+
+/**
+ * Overwrites the u64 at `at` in the index file (keeps the json file as it
+ * is, so the index is still used).
+ */
+void patch_index(const std::string& path, std::uint64_t at,
+                 std::uint64_t value) {
+    std::fstream index(sidecar::index_path(path),
+                       std::ios::binary | std::ios::in | std::ios::out);
+    index.seekp(at);
+    index.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} // namespace
+
+TEST_CASE("apply selectors with a sidecar index", "[index]") {
+    const std::string content =
+        R"#( {"a": [{"b": 1, "c": [1, 2]}, {"b": 2}], "d": "x\"}",
+              "e": {"z": 1, "y": [true]}, "d": "second"} )#";
+    const json::JsonNode json = json::parse_json(content);
+    const std::string path = write_indexed_json(content);
+    parallel::ThreadPool pool(2);
+
+    for (std::size_t depth : {1, 2, 5}) {
+        sidecar::build_index(path, depth);
+        std::optional<sidecar::Index> index = sidecar::Index::open(path);
+        REQUIRE(index);
+
+        for (const char* s :
+             {R"#("a")#", R"#("a"[0]."c"[1])#", R"#("a"|"b")#",
+              R"#("a"[0]{"c", "b"})#", R"#("d", "a"[1], "e"."y"[0])#",
+              R"#("a"[0:1])#", R"#(."e")#"}) {
+            const auto selectors = selectors::parse_selectors(s);
+            REQUIRE(sidecar::apply(selectors, *index, {}) ==
+                    selectors.apply(json));
+            REQUIRE(sidecar::apply(selectors, *index, {.pool = &pool}) ==
+                    selectors.apply(json));
+        }
+
+        // same errors as without index
+        for (const char* s : {R"#("x")#", R"#("a"[2])#", R"#("d"[0])#",
+                              R"#("a"."b")#", R"#("e"[0])#",
+                              R"#("d", "a"[0]."x")#"}) {
+            const auto selectors = selectors::parse_selectors(s);
+            std::string expected;
+            try {
+                selectors.apply(json);
+            } catch (const selectors::ApplySelectorError& e) {
+                expected = e.what();
+            }
+            REQUIRE(!expected.empty());
+            REQUIRE_THROWS_WITH(sidecar::apply(selectors, *index, {}),
+                                expected);
+        }
+    }
+}
+
+TEST_CASE("ignore a stale sidecar index", "[index]") {
+    const std::string path = write_indexed_json(R"#({"a": 1})#");
+    std::filesystem::remove(sidecar::index_path(path));
+    REQUIRE(!sidecar::Index::open(path));
+
+    sidecar::build_index(path, 1);
+    REQUIRE(sidecar::Index::open(path));
+
+    // different size
+    write_indexed_json(R"#({"a": 12})#");
+    REQUIRE(!sidecar::Index::open(path));
+}
+
+TEST_CASE("ignore a damaged sidecar index", "[index]") {
+    const std::string path = write_indexed_json(R"#({"a": 1})#");
+    const std::string index = sidecar::index_path(path);
+    std::ofstream(index, std::ios::trunc) << "short";
+    REQUIRE(!sidecar::Index::open(path));
+    std::ofstream(index, std::ios::trunc)
+        << "not an index but long enough for the header of one";
+    REQUIRE(!sidecar::Index::open(path));
+    std::filesystem::remove(index);
+}
+
+TEST_CASE("ignore a sidecar index with damaged tables", "[index]") {
+    const std::string content = R"#({"a": [1, 2], "b": {"c": true}})#";
+    const std::string path = write_indexed_json(content);
+    const json::JsonNode json = json::parse_json(content);
+    const auto selectors = selectors::parse_selectors(R"#("a", "b"."c")#");
+
+    // the root table is the last one, right after the table of "b"
+    sidecar::build_index(path, 2);
+    const std::uint64_t root = sidecar::Index::open(path)->root();
+    const std::uint64_t first = root + 16;
+    const std::uint64_t second = first + 40;
+
+    // far outside of the index and the json file
+    constexpr std::uint64_t FAR = std::uint64_t{1} << 40;
+    struct Damage {
+        std::uint64_t at;
+        std::uint64_t value;
+    };
+    for (const Damage damage : {
+             Damage{root, 7},          // table type
+             Damage{root + 8, FAR},    // entry count
+             Damage{first, FAR},       // key offset
+             Damage{first + 8, FAR},   // key length
+             Damage{first + 24, FAR},  // end of "a"
+             Damage{first + 16, 100},  // begin of "a" after its end
+             Damage{first + 16, 0},    // "a" is not json
+             Damage{second + 32, FAR}, // table of "b"
+         }) {
+        sidecar::build_index(path, 2);
+        patch_index(path, damage.at, damage.value);
+        std::optional<sidecar::Index> index = sidecar::Index::open(path);
+        REQUIRE(index);
+        REQUIRE(!sidecar::apply(selectors, *index, {}));
+    }
+
+    // an intact index of the same file still answers the query
+    sidecar::build_index(path, 2);
+    REQUIRE(sidecar::apply(selectors, *sidecar::Index::open(path), {}) ==
+            selectors.apply(json));
+    std::filesystem::remove(sidecar::index_path(path));
+}
+
+TEST_CASE("reject invalid json when building an index", "[index]") {
+    for (const char* content : {R"#({"a": 1)#", R"#({"a" 1})#",
+                                R"#([1 2])#", R"#({"a": "x)#"}) {
+        const std::string path = write_indexed_json(content);
+        REQUIRE_THROWS_AS(sidecar::build_index(path, 3), sidecar::IndexError);
+    }
+}
@@ -202,3 +202,54 @@ TEST_CASE("nested objects and arrays are parsed", "[json]") {
                                            JsonNode(JsonString("y")))}))})))}));
     }
 }
+
+TEST_CASE("object lookup", "[json]") {
+    auto obj = single_node<JsonObject>(R"#({"key1": 1, "key2": "x"})#");
+    REQUIRE(obj.find("key1") != nullptr);
+    REQUIRE(*obj.find("key1") == JsonNode(JsonNumber("1")));
+    REQUIRE(obj.find("key3") == nullptr);
+    REQUIRE(obj.at("key2") == JsonNode(JsonString("x")));
+    REQUIRE_THROWS_AS(obj.at("key3"), std::out_of_range);
+}
+
+TEST_CASE("memory usage", "[json]") {
+    SECTION("scalars are only the node") {
+        const MemoryUsage usage = parse_json("true").memory_usage();
+        REQUIRE(usage.nodes == sizeof(JsonNode));
+        REQUIRE(usage.total() == sizeof(JsonNode));
+        REQUIRE(parse_json("12").memory_usage().total() == sizeof(JsonNode));
+    }
+
+    SECTION("long strings have a heap buffer") {
+        const std::string content(100, 'x');
+        const MemoryUsage usage =
+            parse_json("\"" + content + "\"").memory_usage();
+        REQUIRE(usage.strings > content.size());
+        REQUIRE(usage.nodes == sizeof(JsonNode));
+        REQUIRE(parse_json(R"#("short")#").memory_usage().strings == 0);
+    }
+
+    SECTION("arrays count their items and the unused capacity") {
+        const JsonArray array(std::vector{JsonNode(JsonNumber("1")),
+                                          JsonNode(JsonLiteral(JSON_NULL))});
+        const MemoryUsage usage = JsonNode(array).memory_usage();
+        REQUIRE(usage.nodes == 3 * sizeof(JsonNode));
+        REQUIRE(usage.vector_slack ==
+                (array.get().capacity() - 2) * sizeof(JsonNode));
+    }
+
+    SECTION("objects count the map and the keys twice") {
+        const std::string long_key(40, 'k');
+        const MemoryUsage usage =
+            parse_json(R"#({"a": 1, ")#" + long_key + R"#(": [2]})#")
+                .memory_usage();
+        // the object, the two values and the item of the array
+        REQUIRE(usage.nodes == 4 * sizeof(JsonNode));
+        REQUIRE(usage.map_overhead > 0);
+        REQUIRE(usage.keys > 2 * sizeof(std::string) + long_key.size());
+        REQUIRE(usage.order > 2 * sizeof(std::string) + long_key.size());
+        REQUIRE(usage.total() == usage.nodes + usage.strings + usage.keys +
+                                     usage.map_overhead + usage.order +
+                                     usage.vector_slack);
+    }
+}
@@ -4,3 +4,17 @@
 #include "json.hpp"
 #include "selectors.hpp"
 #include "apply_selectors.hpp"
+#include "parallel.hpp"
+#include "stream.hpp"
+#include "memory.hpp"
+#include "server.hpp"
+#include "snapshot.hpp"
+#include "index.hpp"
+#include "cache.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "explain.hpp"
+#include "counters.hpp"
+#include "perf.hpp"
+#include "corpus.hpp"
+#include "cli.hpp"
@@ -0,0 +1,29 @@
+#include <catch/catch.hpp>
+
+#include <cstdint>
+#include <memory>
+
+#include "memory/allocations.hpp"
+#include "json/json.hpp"
+
+TEST_CASE("count allocations", "[memory]") {
+    memory::count_allocations();
+
+    std::size_t before = memory::allocation_count();
+    auto value = std::make_unique<long>(1);
+    REQUIRE(memory::allocation_count() == before + 1);
+
+    // over-aligned types use the aligned operator new
+    struct alignas(64) Line {
+        char bytes[64];
+    };
+    before = memory::allocation_count();
+    auto line = std::make_unique<Line>();
+    REQUIRE(memory::allocation_count() == before + 1);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(line.get()) % 64 == 0);
+
+    // parsing a document allocates its nodes
+    before = memory::allocation_count();
+    json::JsonNode json = json::parse_json(R"({"a": [1, 2, 3]})");
+    REQUIRE(memory::allocation_count() > before);
+}
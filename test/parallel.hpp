@@ -0,0 +1,138 @@
+#include <catch/catch.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel/thread_pool.hpp"
+
+using namespace parallel;
+
+TEST_CASE("parallel_for calls every index exactly once", "[parallel]") {
+    ThreadPool pool(4);
+    for (std::size_t n : {0ul, 1ul, 2ul, 7ul, 1000ul, 100000ul}) {
+        std::vector<std::atomic<int>> calls(n);
+        parallel_for(&pool, n, [&calls](std::size_t i) { calls[i]++; });
+        for (const auto& c : calls) {
+            REQUIRE(c == 1);
+        }
+    }
+}
+
+TEST_CASE("parallel_for runs serially without a pool", "[parallel]") {
+    std::vector<std::size_t> order;
+    parallel_for(nullptr, 5, [&order](std::size_t i) { order.push_back(i); });
+    REQUIRE(order == std::vector<std::size_t>{0, 1, 2, 3, 4});
+}
+
+TEST_CASE("nested parallel_for does not deadlock", "[parallel]") {
+    ThreadPool pool(3);
+    std::atomic<std::size_t> sum{0};
+    parallel_for(&pool, 50, [&pool, &sum](std::size_t i) {
+        parallel_for(&pool, 50, [&pool, &sum, i](std::size_t j) {
+            parallel_for(&pool, 4, [&sum, i, j](std::size_t k) {
+                sum += i * 10000 + j * 10 + k;
+            });
+        });
+    });
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < 50; ++i) {
+        for (std::size_t j = 0; j < 50; ++j) {
+            for (std::size_t k = 0; k < 4; ++k) {
+                expected += i * 10000 + j * 10 + k;
+            }
+        }
+    }
+    REQUIRE(sum == expected);
+}
+
+TEST_CASE("parallel_for rethrows the error of the lowest index",
+          "[parallel]") {
+    ThreadPool pool(4);
+    for (int round = 0; round < 100; ++round) {
+        REQUIRE_THROWS_WITH(parallel_for(&pool, 64,
+                                         [](std::size_t i) {
+                                             if (i % 8 == 3) {
+                                                 throw std::runtime_error(
+                                                     std::to_string(i));
+                                             }
+                                         }),
+                            "3");
+    }
+}
+
+TEST_CASE("parallel_reduce is deterministic", "[parallel]") {
+    ThreadPool pool(4);
+    const std::size_t n = 100000;
+    auto sum = [](std::size_t begin, std::size_t end) {
+        std::size_t s = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+            s += i;
+        }
+        return s;
+    };
+    auto plus = [](std::size_t a, std::size_t b) { return a + b; };
+    REQUIRE(parallel_reduce(&pool, n, 100, std::size_t{0}, sum, plus) ==
+            n * (n - 1) / 2);
+    REQUIRE(parallel_reduce(&pool, 0, 100, std::size_t{42}, sum, plus) == 42);
+
+    // string concatenation is associative but not commutative
+    auto digits = [](std::size_t begin, std::size_t end) {
+        std::string s;
+        for (std::size_t i = begin; i < end; ++i) {
+            s += static_cast<char>('0' + i % 10);
+        }
+        return s;
+    };
+    auto concat = [](std::string a, const std::string& b) { return a + b; };
+    REQUIRE(parallel_reduce(&pool, 1000, 10, std::string{}, digits, concat) ==
+            parallel_reduce(nullptr, 1000, 10, std::string{}, digits, concat));
+}
+
+TEST_CASE("parallel_concat keeps the order of the chunks", "[parallel]") {
+    ThreadPool pool(4);
+    auto body = [](std::size_t begin, std::size_t end,
+                   std::vector<std::size_t>& out) {
+        for (std::size_t i = begin; i < end; ++i) {
+            if (i % 3 != 0) {
+                out.push_back(i);
+            }
+        }
+    };
+    REQUIRE(parallel_concat<std::size_t>(&pool, 10000, 16, body) ==
+            parallel_concat<std::size_t>(nullptr, 10000, 16, body));
+}
+
+TEST_CASE("thread pool runs all tasks submitted from many threads",
+          "[parallel]") {
+    std::atomic<int> count{0};
+    {
+        ThreadPool pool(4, Affinity::PIN_WORKERS);
+        std::vector<std::thread> submitters;
+        for (int t = 0; t < 4; ++t) {
+            submitters.emplace_back([&pool, &count] {
+                for (int i = 0; i < 2500; ++i) {
+                    pool.submit([&count] { count++; });
+                }
+            });
+        }
+        for (auto& t : submitters) {
+            t.join();
+        }
+        // the destructor runs the remaining tasks
+    }
+    REQUIRE(count == 10000);
+}
+
+TEST_CASE("parallel_invoke runs both functions", "[parallel]") {
+    ThreadPool pool(2);
+    int a = 0;
+    int b = 0;
+    parallel_invoke(
+        &pool, [&a] { a = 1; }, [&b] { b = 2; });
+    REQUIRE(a + b == 3);
+}
@@ -0,0 +1,40 @@
+#include <catch/catch.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "perf/perf.hpp"
+
+TEST_CASE("perf counters or a reason why there are none", "[perf]") {
+    perf::Counters counters;
+    long sum = 0;
+    const perf::Sample sample = perf::measure(counters, [&sum] {
+        for (long i = 0; i < 100000; ++i) {
+            sum += i;
+            // keeps the compiler from removing the loop
+            asm volatile("" : "+r"(sum));
+        }
+    });
+    if (counters.available()) {
+        REQUIRE(sample.values[perf::INSTRUCTIONS].value_or(1) > 0);
+    } else {
+        REQUIRE(!counters.reason().empty());
+        for (const auto& value : sample.values) {
+            REQUIRE(!value);
+        }
+    }
+}
+
+TEST_CASE("perf sample", "[perf]") {
+    perf::Sample sample;
+    sample.values[perf::CYCLES] = 200;
+    sample.values[perf::INSTRUCTIONS] = 300;
+    REQUIRE(*sample.ipc() == Approx(1.5));
+    REQUIRE(*sample.per(100).values[perf::CYCLES] == Approx(2));
+    REQUIRE(!sample.per(100).values[perf::LLC_MISSES]);
+
+    std::ostringstream out;
+    perf::print(out, sample);
+    REQUIRE(out.str().starts_with("cycles=200 instructions=300 ipc=1.5 "));
+    REQUIRE(out.str().ends_with("dtlb_misses=n/a"));
+}
@@ -0,0 +1,169 @@
+#include <catch/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json/json.hpp"
+#include "parallel/thread_pool.hpp"
+#include "server/document.hpp"
+#include "server/server.hpp"
+#include "server/watcher.hpp"
+
+using namespace server;
+
+TEST_CASE("answer queries over a unix socket", "[server]") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_test.sock")
+            .string();
+    Document document(
+        json::parse_json(R"#({"a": [1, 2, 3], "b": {"c": "x"}})#"));
+
+    parallel::ThreadPool pool(4);
+    Server server(document, path, {.pool = &pool});
+    std::thread serving([&server] { server.serve(); });
+
+    {
+        Client client(path);
+        REQUIRE(client.query(R"#("a")#") ==
+                std::pair{Status::OK, std::string("[1,2,3]")});
+        REQUIRE(client.query(R"#("b"."c", "a"[1])#") ==
+                std::pair{Status::OK, std::string(R"#(["x",2])#")});
+        REQUIRE(client.query(R"#("x")#") ==
+                std::pair{Status::ERROR,
+                          std::string("Key \"x\" was not found in json "
+                                      "object")});
+        REQUIRE(client.query(R"#("a"[)#").first == Status::ERROR);
+        // the connection is still usable after errors
+        REQUIRE(client.query(R"#("a"[2])#") ==
+                std::pair{Status::OK, std::string("3")});
+    }
+
+    {
+        std::vector<std::thread> clients;
+        std::vector<std::string> results(8);
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            clients.emplace_back([&path, &results, i] {
+                Client client(path);
+                for (int j = 0; j < 50; ++j) {
+                    results[i] = client.query(R"#("a"[0])#").second;
+                }
+            });
+        }
+        for (std::thread& client : clients) {
+            client.join();
+        }
+        REQUIRE(results == std::vector<std::string>(8, "1"));
+    }
+
+    LoadStats stats = run_load(path, R"#("b")#", 3, 100);
+    REQUIRE(stats.requests == 100);
+    REQUIRE(stats.errors == 0);
+    REQUIRE(stats.p50 <= stats.p99);
+    REQUIRE(stats.p99 <= stats.max);
+
+    // an idle connection doesn't keep the server from stopping
+    Client idle(path);
+    REQUIRE(idle.query(R"#("a"[1])#").second == "2");
+    server.stop();
+    serving.join();
+    REQUIRE_THROWS_AS(idle.query(R"#("a")#"), ServerError);
+}
+
+TEST_CASE("connections don't take threads from the queries", "[server]") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_pools.sock")
+            .string();
+    std::string array = "[0";
+    for (int i = 1; i < 100000; ++i) {
+        array += "," + std::to_string(i);
+    }
+    Document document(json::parse_json(array + "]"));
+
+    parallel::ThreadPool pool(1);
+    Server server(document, path, {.pool = &pool});
+    std::thread serving([&server] { server.serve(); });
+    {
+        // both connections are open at the same time and the second one is
+        // answered although the query pool has only one worker
+        Client first(path);
+        REQUIRE(first.query("[99999]").second == "99999");
+        Client second(path);
+        REQUIRE(second.query("[1:2]").second == "[1,2]");
+        REQUIRE(first.query("[0]").second == "0");
+    }
+    server.stop();
+    serving.join();
+}
+
+TEST_CASE("replace the document while it is queried", "[server]") {
+    Document document(json::parse_json(R"#({"v": 1})#"));
+    std::shared_ptr<const json::JsonNode> snapshot = document.get();
+
+    std::thread reload([&document] {
+        document.replace(json::parse_json(R"#({"v": 2})#"));
+    });
+    // the new version is visible right away ...
+    while (document.get_version() != 2) {
+        std::this_thread::yield();
+    }
+    REQUIRE(*document.get() == json::parse_json(R"#({"v": 2})#"));
+    // ... but the old snapshot stays valid until it is released
+    REQUIRE(*snapshot == json::parse_json(R"#({"v": 1})#"));
+    snapshot.reset();
+    reload.join();
+
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_reload.sock")
+            .string();
+    parallel::ThreadPool pool(2);
+    Server server(document, path, {.pool = &pool});
+    std::thread serving([&server] { server.serve(); });
+    {
+        Client client(path);
+        REQUIRE(client.query(R"#("v")#").second == "2");
+        document.replace(json::parse_json(R"#({"v": 3})#"));
+        REQUIRE(client.query(R"#("v")#").second == "3");
+    }
+    server.stop();
+    serving.join();
+}
+
+TEST_CASE("watch a file for changes", "[server]") {
+    const std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / "jsonquery_test_watch";
+    std::filesystem::create_directories(dir);
+    const std::filesystem::path file = dir / "doc.json";
+    std::ofstream(file) << "1";
+
+    std::atomic<int> changes = 0;
+    auto wait_for = [&changes](int expected) {
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (changes < expected &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return changes.load();
+    };
+    {
+        FileWatcher watcher(file.string(), [&changes] { ++changes; });
+
+        // other files in the same directory are ignored
+        std::ofstream(dir / "other.json") << "2";
+        std::ofstream(file) << "2";
+        REQUIRE(wait_for(1) == 1);
+
+        // replaced by renaming a new version over it
+        std::ofstream(dir / "doc.json.tmp") << "3";
+        std::filesystem::rename(dir / "doc.json.tmp", file);
+        REQUIRE(wait_for(2) == 2);
+    }
+
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,126 @@
+#include <catch/catch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "parallel/thread_pool.hpp"
+#include "selectors/selectors.hpp"
+#include "snapshot/snapshot.hpp"
+#include "json/json.hpp"
+
+using namespace snapshot;
+
+namespace {
+
+std::string write_test_snapshot(const json::JsonNode& json) {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_test.jqs")
+            .string();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    write_snapshot(json, out);
+    return path;
+}
+
+} // namespace
+
+TEST_CASE("snapshot round trip", "[snapshot]") {
+    const json::JsonNode json = json::parse_json(
+        R"#({"z": [1, -2.5e3, "x\"y", true, false, null, [], {}],
+             "a": {"c": 1, "b": 2, "a": 3}, "m": " "})#");
+    const std::string path = write_test_snapshot(json);
+    REQUIRE(is_snapshot(path));
+
+    Snapshot snapshot(path);
+    const json::JsonNode decoded = snapshot.root().decode();
+    REQUIRE(decoded == json);
+    // the order of the keys is kept
+    std::ostringstream original, copy;
+    original << json;
+    copy << decoded;
+    REQUIRE(copy.str() == original.str());
+
+    REQUIRE(snapshot.root().tag() == TAG_OBJECT);
+    REQUIRE(snapshot.root().find("a")->find("b")->text() == "2");
+    REQUIRE(!snapshot.root().find("b"));
+    REQUIRE(snapshot.root().find("z")->item(2).text() == "x\\\"y");
+}
+
+TEST_CASE("apply selectors to a snapshot", "[snapshot]") {
+    const json::JsonNode json = json::parse_json(
+        R"#({"a": [{"b": 1, "c": [1, 2]}, {"b": 2}], "d": "x"})#");
+    const std::string path = write_test_snapshot(json);
+    Snapshot snapshot(path);
+    parallel::ThreadPool pool(2);
+
+    for (const char* s :
+         {R"#("a")#", R"#("a"[0]."c"[1])#", R"#("a"|"b")#",
+          R"#("a"[0]{"c", "b"})#", R"#("d", "a"[1], "a"[0]."c"[0:1])#",
+          R"#("a"[0:1])#"}) {
+        const auto selectors = selectors::parse_selectors(s);
+        REQUIRE(apply(selectors, snapshot, {}) == selectors.apply(json));
+        REQUIRE(apply(selectors, snapshot, {.pool = &pool}) ==
+                selectors.apply(json));
+    }
+
+    // same errors as without snapshot
+    for (const char* s : {R"#("x")#", R"#("a"[2])#", R"#("d"[0])#",
+                          R"#("a"."b")#", R"#("d", "a"[0]."x")#"}) {
+        const auto selectors = selectors::parse_selectors(s);
+        std::string expected;
+        try {
+            selectors.apply(json);
+        } catch (const selectors::ApplySelectorError& e) {
+            expected = e.what();
+        }
+        REQUIRE(!expected.empty());
+        REQUIRE_THROWS_WITH(apply(selectors, snapshot, {}), expected);
+    }
+}
+
+TEST_CASE("reject files that are not snapshots", "[snapshot]") {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jsonquery_test.json")
+            .string();
+    std::ofstream(path) << R"#({"a": "some json that is long enough"})#";
+    REQUIRE(!is_snapshot(path));
+    REQUIRE_THROWS_AS(Snapshot(path), SnapshotError);
+}
+
+TEST_CASE("corrupt snapshots throw instead of reading out of bounds",
+          "[snapshot]") {
+    std::ostringstream out;
+    write_snapshot(json::parse_json(R"#({"a": [1, "x"], "b": {"c": null}})#"),
+                   out);
+    const std::string bytes = out.str();
+    std::uint64_t root;
+    std::memcpy(&root, bytes.data() + 16, sizeof(root));
+    auto data = [](const std::string& s) {
+        return reinterpret_cast<const std::byte*>(s.data());
+    };
+
+    // cut off after the root node: all its children are missing
+    const std::string truncated = bytes.substr(0, root + 1);
+    REQUIRE_THROWS_AS(NodeRef(data(bytes), truncated.size(), root).decode(),
+                      SnapshotError);
+    REQUIRE_THROWS_AS(NodeRef(data(bytes), root, root), SnapshotError);
+
+    // any single damaged byte: either still decodes or throws
+    for (std::size_t i = HEADER_SIZE; i < bytes.size(); ++i) {
+        for (unsigned char value : {0x00, 0x7f, 0xff}) {
+            std::string damaged = bytes;
+            damaged[i] = static_cast<char>(value);
+            const NodeRef node(data(damaged), damaged.size(), root);
+            try {
+                node.decode();
+                node.find("a");
+                node.find("b");
+            } catch (const SnapshotError&) {
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#include <catch/catch.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "stats/stats.hpp"
+#include "json/json.hpp"
+
+TEST_CASE("count nodes by type", "[stats]") {
+    const json::JsonNode json = json::parse_json(
+        R"#({"a": [1, 2.5, "x", true, null, [], {}], "b": {"c": false}})#");
+    const stats::NodeCounts counts = stats::count_nodes(json);
+    REQUIRE(counts.objects == 3);
+    REQUIRE(counts.arrays == 2);
+    REQUIRE(counts.strings == 1);
+    REQUIRE(counts.numbers == 2);
+    REQUIRE(counts.literals == 3);
+    REQUIRE(counts.total() == 11);
+
+    REQUIRE(stats::count_nodes(json::parse_json("1")).total() == 1);
+}
+
+TEST_CASE("count bytes written through a stream", "[stats]") {
+    std::ostringstream target;
+    stats::CountingBuffer counter(target.rdbuf());
+    std::ostream out(&counter);
+    out << json::parse_json(R"#({"a": [1, 2]})#") << 'x' << std::flush;
+    REQUIRE(target.str() == R"#({"a":[1,2]}x)#");
+    REQUIRE(counter.get_count() == target.str().size());
+}
+
+TEST_CASE("stats report", "[stats]") {
+    stats::Report report;
+    REQUIRE(report.time("first", [] { return 42; }) == 42);
+    REQUIRE_THROWS(report.time("second", []() -> int { throw 1; }));
+    report.input_bytes = 1000;
+    report.output_nodes = stats::NodeCounts{.strings = 1};
+
+    // phases that throw are recorded too
+    std::ostringstream text;
+    report.print(text);
+    REQUIRE(text.str().find("first: ") != std::string::npos);
+    REQUIRE(text.str().find("second: ") != std::string::npos);
+    REQUIRE(text.str().find("input: 1000 bytes") != std::string::npos);
+
+    std::ostringstream json_text;
+    report.print_json(json_text);
+    // the precision of the stream is restored
+    REQUIRE(json_text.precision() == std::ostringstream().precision());
+    const json::JsonNode json = json::parse_json(json_text.str());
+    const auto& object = json.as<json::JsonObject>();
+    REQUIRE(object.at("phases").as<json::JsonObject>().keys() ==
+            std::vector<std::string>{"first", "second"});
+    REQUIRE(object.at("input_bytes") == json::parse_json("1000"));
+    REQUIRE(object.find("input_nodes") == nullptr);
+    REQUIRE(object.at("output_nodes").as<json::JsonObject>().at("total") ==
+            json::parse_json("1"));
+}
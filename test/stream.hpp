@@ -0,0 +1,211 @@
+#include <catch/catch.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parallel/thread_pool.hpp"
+#include "selectors/selectors.hpp"
+#include "stream/files.hpp"
+#include "stream/lines.hpp"
+#include "stream/values.hpp"
+
+using namespace stream;
+
+TEST_CASE("process newline delimited json", "[stream]") {
+    std::istringstream in("{\"a\": 1}\n"
+                          "\n"
+                          "{\"a\": [2, 3], \"b\": 2}\r\n"
+                          "{\"a\": \"x\"}");
+    std::ostringstream out;
+    auto selectors = selectors::parse_selectors(R"#("a")#");
+    REQUIRE(process_lines(in, out, selectors, {}) == 3);
+    REQUIRE(out.str() == "1\n[2,3]\n\"x\"\n");
+}
+
+TEST_CASE("process newline delimited json reports failing record",
+          "[stream]") {
+    auto selectors = selectors::parse_selectors(R"#("a")#");
+    {
+        std::istringstream in("{\"a\": 1}\n{\"b\": 1}\n");
+        std::ostringstream out;
+        REQUIRE_THROWS_WITH(
+            process_lines(in, out, selectors, {}),
+            "record 2: Key \"a\" was not found in json object");
+        REQUIRE(out.str() == "1\n");
+    }
+    {
+        std::istringstream in("\n{\"a\": 1\n");
+        std::ostringstream out;
+        REQUIRE_THROWS_AS(process_lines(in, out, selectors, {}), RecordError);
+    }
+}
+
+TEST_CASE("process newline delimited json in parallel", "[stream]") {
+    std::string input;
+    for (int i = 0; i < 2000; ++i) {
+        input += R"#({"a": )#" + std::to_string(i) + "}\n";
+        if (i % 100 == 0) {
+            input += "\n";
+        }
+    }
+    input += R"#({"a": "no newline at the end"})#";
+    auto selectors = selectors::parse_selectors(R"#("a")#");
+
+    std::istringstream serial_in(input);
+    std::ostringstream serial_out;
+    process_lines(serial_in, serial_out, selectors, {});
+
+    parallel::ThreadPool pool(3);
+    selectors::ApplyContext ctx{.pool = &pool};
+    for (std::size_t chunk_size : {1ul, 7ul, 100ul, 1ul << 20}) {
+        std::istringstream in(input);
+        std::ostringstream out;
+        REQUIRE(process_lines_parallel(
+                    in, out, selectors, ctx,
+                    {.chunk_size = chunk_size, .max_in_flight = 3}) == 2001);
+        REQUIRE(out.str() == serial_out.str());
+    }
+
+    std::istringstream in(input);
+    std::ostringstream out;
+    process_lines_parallel(in, out, selectors, ctx,
+                           {.chunk_size = 64, .ordered = false});
+    std::string sorted_out = out.str();
+    std::string sorted_expected = serial_out.str();
+    std::ranges::sort(sorted_out);
+    std::ranges::sort(sorted_expected);
+    REQUIRE(sorted_out == sorted_expected);
+}
+
+TEST_CASE("process newline delimited json in parallel reports failing record",
+          "[stream]") {
+    std::string input;
+    for (int i = 0; i < 500; ++i) {
+        input += i == 321 ? "{\"b\": 1}\n" : "{\"a\": 1}\n";
+    }
+    auto selectors = selectors::parse_selectors(R"#("a")#");
+    parallel::ThreadPool pool(3);
+    std::istringstream in(input);
+    std::ostringstream out;
+    REQUIRE_THROWS_WITH(
+        process_lines_parallel(in, out, selectors, {.pool = &pool},
+                               {.chunk_size = 50}),
+        "record 322: Key \"a\" was not found in json object");
+    std::string expected;
+    for (int i = 0; i < 321; ++i) {
+        expected += "1\n";
+    }
+    REQUIRE(out.str() == expected);
+}
+
+TEST_CASE("split concatenated json values", "[stream]") {
+    std::istringstream in(R"#({"a": "}{"}[1,[2]]"x\"y" 12 -3.5e2true null)#"
+                          "\n{\n  \"b\": {}\n}\n ");
+    ValueReader reader(in);
+    std::vector<std::string> values;
+    std::string value;
+    while (reader.next(value)) {
+        values.push_back(value);
+    }
+    REQUIRE(values == std::vector<std::string>{
+                          R"#({"a": "}{"})#", "[1,[2]]", R"#("x\"y")#", "12",
+                          "-3.5e2true", "null", "{\n  \"b\": {}\n}"});
+}
+
+TEST_CASE("process concatenated json values", "[stream]") {
+    auto selectors = selectors::parse_selectors(R"#("a")#");
+    {
+        std::istringstream in("{\"a\": 1}{\"a\": [2, 3]}\n"
+                              "{\n  \"a\": \"x\"\n}");
+        std::ostringstream out;
+        REQUIRE(process_values(in, out, selectors, {}) == 3);
+        REQUIRE(out.str() == "1\n[2,3]\n\"x\"\n");
+    }
+    {
+        std::istringstream in("{\"a\": 1} {\"a\": 2}\n\n"
+                              "{\"a\": 3}");
+        std::ostringstream out;
+        REQUIRE(process_values(in, out, selectors, {}) == 3);
+        REQUIRE(out.str() == "1\n2\n3\n");
+    }
+    {
+        std::istringstream in("{\"a\": 1} {\"a\": 2}} {\"a\": 3}");
+        std::ostringstream out;
+        REQUIRE_THROWS_AS(process_values(in, out, selectors, {}),
+                          RecordError);
+        REQUIRE(out.str() == "1\n2\n");
+    }
+    {
+        std::istringstream in("{\"a\": 1}[1]");
+        std::ostringstream out;
+        REQUIRE_THROWS_WITH(
+            process_values(in, out, selectors, {}),
+            "record 2: selector and json object don't match: Key, Array");
+    }
+}
+
+TEST_CASE("process many files", "[stream]") {
+    const std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / "jsonquery_test_files";
+    std::filesystem::create_directories(dir);
+
+    std::vector<std::string> files;
+    std::string expected;
+    for (int i = 0; i < 50; ++i) {
+        const std::string file = dir / (std::to_string(i) + ".json");
+        std::ofstream(file) << "{\"a\": " << i << ", \"b\": [1, 2]}";
+        files.push_back(file);
+        expected += std::to_string(i) + "\n";
+    }
+    auto selectors = selectors::parse_selectors(R"#("a")#");
+
+    {
+        std::ostringstream out, err;
+        FilesResult result = process_files(files, out, err, selectors, {});
+        REQUIRE(result.processed == 50);
+        REQUIRE(result.failed == 0);
+        REQUIRE(out.str() == expected);
+        REQUIRE(err.str().empty());
+    }
+    {
+        parallel::ThreadPool pool(3);
+        for (std::size_t max_in_flight : {0ul, 1ul, 3ul}) {
+            std::ostringstream out, err;
+            process_files(files, out, err, selectors, {.pool = &pool},
+                          {.max_in_flight = max_in_flight});
+            REQUIRE(out.str() == expected);
+        }
+    }
+    {
+        std::ofstream(files[1]) << "[1]";
+        const std::vector<std::string> some{files[0], files[1],
+                                            (dir / "missing.json").string(),
+                                            dir.string(), files[3]};
+        parallel::ThreadPool pool(2);
+        std::ostringstream out, err;
+        FilesResult result = process_files(some, out, err, selectors,
+                                           {.pool = &pool},
+                                           {.with_filename = true});
+        REQUIRE(result.processed == 5);
+        REQUIRE(result.failed == 3);
+        REQUIRE(out.str() == files[0] + ":0\n" + files[3] + ":3\n");
+        REQUIRE(err.str() ==
+                files[1] +
+                    ": selector and json object don't match: Key, Array\n" +
+                    (dir / "missing.json").string() +
+                    ": error reading input file\n" + dir.string() +
+                    ": error reading input file\n");
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("read list of files", "[stream]") {
+    std::istringstream in("a.json\n\nb c.json\r\n/tmp/d.json");
+    REQUIRE(read_file_list(in) ==
+            std::vector<std::string>{"a.json", "b c.json", "/tmp/d.json"});
+}
@@ -0,0 +1,62 @@
+#include <catch/catch.hpp>
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "parallel/thread_pool.hpp"
+#include "selectors/selectors.hpp"
+#include "trace/trace.hpp"
+#include "json/json.hpp"
+
+TEST_CASE("trace spans of all threads", "[trace]") {
+    { trace::Span ignored("before_enable"); }
+
+    trace::enable();
+    trace::name_thread("test main");
+    {
+        trace::Span outer("outer");
+        std::thread([] {
+            trace::Span inner("on_other_thread", "number", 7);
+        }).join();
+        parallel::ThreadPool pool(2);
+        const auto selectors = selectors::parse_selectors(R"#("a", "b")#");
+        selectors.apply(json::parse_json(R"#({"a": 1, "b": 2})#"), &pool);
+    }
+    trace::disable();
+    { trace::Span ignored("after_disable"); }
+
+    std::ostringstream out;
+    trace::write(out);
+    const std::string trace = out.str();
+    // valid json
+    REQUIRE_NOTHROW(json::parse_json(trace));
+
+    REQUIRE(trace.find(R"#("args":{"name":"test main"})#") !=
+            std::string::npos);
+    REQUIRE(trace.find(R"#({"name":"outer","cat":"jsonquery","ph":"X")#") !=
+            std::string::npos);
+    REQUIRE(trace.find(R"#("args":{"number":7})#") != std::string::npos);
+    REQUIRE(trace.find(R"#("args":{"index":0})#") != std::string::npos);
+    REQUIRE(trace.find(R"#("args":{"index":1})#") != std::string::npos);
+    REQUIRE(trace.find("before_enable") == std::string::npos);
+    REQUIRE(trace.find("after_disable") == std::string::npos);
+}
+
+TEST_CASE("drop the events that don't fit into the buffer", "[trace]") {
+    trace::enable();
+    const std::size_t before = trace::dropped_events();
+    std::thread([] {
+        trace::name_thread("full");
+        for (std::size_t i = 0; i < trace::MAX_EVENTS + 5; ++i) {
+            trace::Span span("event");
+        }
+    }).join();
+    trace::disable();
+
+    REQUIRE(trace::dropped_events() == before + 5);
+    std::ostringstream out;
+    trace::write(out);
+    REQUIRE(out.str().find(R"#("args":{"name":"full","dropped_events":5})#") !=
+            std::string::npos);
+}